@@ -56,6 +56,14 @@
 // Force settings to RAM for debug
 #define LOG_TO_RAM  0
 
+// Hosted builds map the log file into memory rather than accessing it through EVFS.
+// Build with USE_LOG_MMAP off to use the EVFS backend.
+#if defined PLATFORM_HOSTED && !LOG_TO_RAM && USE_LOG_MMAP
+#  define LOG_TO_MMAP 1
+#else
+#  define LOG_TO_MMAP 0
+#endif
+
 #if LOG_TO_RAM || defined PLATFORM_HOSTED // Small in-memory filesystem for testing
 #  define LOG_NUM_SECTORS 3
 #  define LOG_SECTOR_SIZE 128
@@ -65,13 +73,32 @@
     // STORAGE0 in STM32 sectors 1-3
 #    define LOG_NUM_SECTORS 3
 #    define LOG_SECTOR_SIZE (16 * 1024)
+    // STORAGE1 in bank 2 sectors 12-13
+#    define ERROR_LOG_NUM_SECTORS 2
+#    define ERROR_LOG_SECTOR_SIZE (16 * 1024)
 #  elif defined BOARD_STM32F401_BLACK_PILL
-    // STORAGE0 in STM32 sectors 1-3
-#    define LOG_NUM_SECTORS 3
+    // STORAGE0 in STM32 sectors 1-2
+#    define LOG_NUM_SECTORS 2
 #    define LOG_SECTOR_SIZE (16 * 1024)
+    // STORAGE1 in STM32 sector 3
+#    define ERROR_LOG_NUM_SECTORS 1
+#    define ERROR_LOG_SECTOR_SIZE (16 * 1024)
 #  endif
 #endif
 
+// Boards with a STORAGE1 flash region keep the error log there
+#ifdef ERROR_LOG_SECTOR_SIZE
+#  define ERROR_LOG_TO_FLASH 1
+#else
+#  define ERROR_LOG_TO_FLASH 0
+#endif
+
+// Persistent prop writes are coalesced until no changes are seen for
+// PERSIST_COALESCE_MS or the first change is PERSIST_MAX_DELAY_MS old
+#define PERSIST_POLL_MS       100
+#define PERSIST_COALESCE_MS   2000
+#define PERSIST_MAX_DELAY_MS  10000
+
 
 // **** Peripheral resources ****
 
@@ -106,6 +133,15 @@
 #endif
 #define AUDIO_DMA_BUF_SAMPLES   512
 
+// Capture ring for the audio tap. Must be a power of 2.
+#ifndef AUDIO_TAP_RING_SAMPLES
+#  ifdef PLATFORM_EMBEDDED
+#    define AUDIO_TAP_RING_SAMPLES  2048
+#  else
+#    define AUDIO_TAP_RING_SAMPLES  16384
+#  endif
+#endif
+
 // ******************** App properties ********************
 
 #define P_DEBUG_SYS_LOCAL_VALUE     (P1_DEBUG | P2_SYS | P3_LOCAL | P4_VALUE)
@@ -132,6 +168,10 @@ extern "C" {
 #endif
 
 void fatal_error(void);
+void app_restart(void);
+uint32_t boot_time_us(void);
+uint32_t elapsed_mark(void);
+uint32_t elapsed_us(uint32_t mark);
 
 
 bool get_led(uint8_t led_id);
@@ -13,6 +13,7 @@ M(P2, VALVE,     70) \
 M(P2, ZONE,      71) \
 M(P2, TOUCH,     72) \
 M(P2, ECU,       73) \
+M(P2, BOOT,      74) \
 \
 M(P3, INST0,    60) \
 M(P3, USER,     61) \
@@ -23,12 +24,20 @@ M(P3, WIDGET,   65) \
 M(P3, UNITS,    66) \
 M(P3, MENU,     67) \
 M(P3, STYLE,    68) \
+M(P3, PROFILE,  69) \
 \
 M(P4, FREQ,     60) \
 M(P4, WAVE,     61) \
 M(P4, CURVE,    62) \
 M(P4, AVERAGE,  63) \
-M(P4, WIDGET,   64)
+M(P4, WIDGET,   64) \
+M(P4, RESTORE,  65) \
+M(P4, FRAME,    66) \
+M(P4, RENDER,   67) \
+M(P4, PIXELS,   68) \
+M(P4, AREAS,    69) \
+M(P4, HANDLER,  70) \
+M(P4, FPS,      71)
 
 
 enum PropElementsApp {
@@ -38,6 +47,10 @@ enum PropElementsApp {
 
 #define P_RSRC_CON_LOCAL_TASK   (P1_RSRC | P2_CON | P3_LOCAL | P4_TASK)
 
+// Boot timing
+#define P_APP_BOOT_INFO_RESTORE   (P1_APP | P2_BOOT | P3_INFO | P4_RESTORE) // Log restore time in us
+#define P_APP_BOOT_INFO_FRAME     (P1_APP | P2_BOOT | P3_INFO | P4_FRAME)   // First GUI frame in ms
+
 #define P_APP_AUDIO_INFO_VALUE    (P1_APP | P2_AUDIO | P3_INFO | P4_VALUE)
 #define P_APP_AUDIO_INST0_FREQ    (P1_APP | P2_AUDIO | P3_INST0 | P4_FREQ)
 #define P_APP_AUDIO_INST0_WAVE    (P1_APP | P2_AUDIO | P3_INST0 | P4_WAVE)
@@ -0,0 +1,88 @@
+#ifndef APP_PROP_SLOTS_H
+#define APP_PROP_SLOTS_H
+
+// Props with a default value in the prop DB. This list generates the DB
+// defaults. The GUI subset also generates the snapshot slot enum and the ID to
+// slot mapping so that reads of known IDs from the GUI compile down to an
+// array index.
+//
+// Only GUI snapshot reads use the slots. prop_get()/prop_set() on the prop DB
+// still go through the hash table for every ID, known or not. Builds without
+// LVGL have no slots and no snapshot so they get neither the speedup nor the
+// extra RAM.
+//
+// M(name, prop_id, def_type, default_value, flags)
+// def_type is P_UINT or P_INT
+
+#define PROP_SLOTS_COMMON(M) \
+M(DEBUG_SYS_LOCAL_VALUE,    P_DEBUG_SYS_LOCAL_VALUE,  P_UINT, 0, 0) /* Debug mode setting */ \
+M(APP_INFO_BUILD_VERSION,   P_APP_INFO_BUILD_VERSION, P_UINT, APP_VERSION_INT, P_PROTECT | P_PERSIST) \
+M(SYS_STORAGE_INFO_COUNT,   P_SYS_STORAGE_INFO_COUNT, P_UINT, 0, P_PROTECT | P_PERSIST) /* Flash write counter */ \
+M(APP_INFO_INFO_VALUE, (P1_APP | P2_INFO | P3_INFO | P4_VALUE), P_UINT, 0, P_PERSIST) /* Dummy persistable value for testing */ \
+M(APP_BOOT_INFO_RESTORE,    P_APP_BOOT_INFO_RESTORE,  P_UINT, 0, P_PROTECT)
+
+#if USE_AUDIO // FIXME: Some are obsolete
+#  define PROP_SLOTS_AUDIO(M) \
+M(APP_AUDIO_INFO_VALUE,     P_APP_AUDIO_INFO_VALUE,   P_UINT, 0, 0) \
+M(APP_AUDIO_INST0_FREQ,     P_APP_AUDIO_INST0_FREQ,   P_UINT, 440, 0) \
+M(APP_AUDIO_INST0_WAVE,     P_APP_AUDIO_INST0_WAVE,   P_UINT, 1, 0) \
+M(APP_AUDIO_INST0_CURVE,    P_APP_AUDIO_INST0_CURVE,  P_UINT, 0, 0)
+#else
+#  define PROP_SLOTS_AUDIO(M)
+#endif
+
+#if USE_LVGL
+#  define PROP_SLOTS_GUI(M) \
+M(APP_GUI_INFO__DARK,           P_APP_GUI_INFO__DARK,           P_UINT, 0, P_PERSIST) \
+M(APP_GUI_UNITS__SPEED,         P_APP_GUI_UNITS__SPEED,         P_UINT, UNIT_MPH, P_PERSIST) \
+M(APP_GUI_UNITS__TEMPERATURE,   P_APP_GUI_UNITS__TEMPERATURE,   P_UINT, UNIT_CELSIUS, P_PERSIST) \
+M(APP_GUI_MENU__MODE,           P_APP_GUI_MENU__MODE,           P_UINT, 0, 0) \
+M(APP_BOOT_INFO_FRAME,          P_APP_BOOT_INFO_FRAME,          P_UINT, 0, P_PROTECT) \
+M(APP_GUI_PROFILE__RENDER,      P_APP_GUI_PROFILE__RENDER,      P_UINT, 0, P_PROTECT) \
+M(APP_GUI_PROFILE__PIXELS,      P_APP_GUI_PROFILE__PIXELS,      P_UINT, 0, P_PROTECT) \
+M(APP_GUI_PROFILE__AREAS,       P_APP_GUI_PROFILE__AREAS,       P_UINT, 0, P_PROTECT) \
+M(APP_GUI_PROFILE__HANDLER,     P_APP_GUI_PROFILE__HANDLER,     P_UINT, 0, P_PROTECT) \
+M(APP_GUI_PROFILE__FPS,         P_APP_GUI_PROFILE__FPS,         P_UINT, 0, P_PROTECT) \
+M(SENSOR_ECU__SPEED__VALUE,     P_SENSOR_ECU__SPEED__VALUE,     P_UINT, 0, 0) /* 24.8 fixed point km/h */ \
+M(SENSOR_ECU__SPEED__AVERAGE,   P_SENSOR_ECU__SPEED__AVERAGE,   P_UINT, 0, 0) /* 24.8 fixed point km/h */ \
+M(SENSOR_ECU__SPEED__MAX,       P_SENSOR_ECU__SPEED__MAX,       P_UINT, 0, 0) /* 24.8 fixed point km/h */ \
+M(SENSOR_ECU__RPM__VALUE,       P_SENSOR_ECU__RPM__VALUE,       P_UINT, 0, 0) \
+M(SENSOR_ECU__SIDESTAND__VALUE, P_SENSOR_ECU__SIDESTAND__VALUE, P_UINT, 0, 0) /* Bool */ \
+M(SENSOR_ECU__GEAR__VALUE,      P_SENSOR_ECU__GEAR__VALUE,      P_UINT, 0, 0) /* 0 - 6 */ \
+M(SENSOR_ECU__VOLTAGE__VALUE,   P_SENSOR_ECU__VOLTAGE__VALUE,   P_UINT, 0, 0) /* 24.8 fixed point */ \
+M(SENSOR_ECU__COOLANT_TEMP__VALUE, P_SENSOR_ECU__COOLANT_TEMP__VALUE, P_INT, 0, 0) /* Celsius */ \
+M(SENSOR_ECU__FUEL__VALUE,      P_SENSOR_ECU__FUEL__VALUE,      P_UINT, 0, 0) /* 0 - 100 % */
+#else
+#  define PROP_SLOTS_GUI(M)
+#endif
+
+#define PROP_SLOTS_APP(M)  PROP_SLOTS_COMMON(M) PROP_SLOTS_AUDIO(M) PROP_SLOTS_GUI(M)
+
+
+#define PROP_SLOT_ENUM_ITEM(name, prop_id, def_type, default_value, flags)  PSLOT_##name,
+#define PROP_SLOT_ID_ITEM(name, prop_id, def_type, default_value, flags)    prop_id,
+#define PROP_SLOT_DEFAULT_ITEM(name, prop_id, def_type, default_value, flags) \
+  def_type(prop_id, default_value, flags),
+#define PROP_SLOT_CASE_ITEM(name, prop_id, def_type, default_value, flags) \
+  case prop_id: return PSLOT_##name;
+
+#if USE_LVGL
+// Only GUI props are mirrored into the prop snapshot. Builds without a GUI
+// have no snapshot reader and don't carry a second copy of the props.
+enum PropSlotsGui {
+  PROP_SLOTS_GUI(PROP_SLOT_ENUM_ITEM)
+  PROP_SLOT_COUNT
+};
+
+
+// Map prop ID to its snapshot slot. Returns -1 for props without a slot.
+// Constant IDs are folded to a constant slot index by the compiler.
+static inline int prop_slot(uint32_t prop) {
+  switch(prop) {
+  PROP_SLOTS_GUI(PROP_SLOT_CASE_ITEM)
+  default: return -1;
+  }
+}
+#endif
+
+#endif // APP_PROP_SLOTS_H
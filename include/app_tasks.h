@@ -3,12 +3,22 @@
 
 #define DEBOUNCE_TASK_MS    11    // Run debounce filter
 #define DEBOUNCE_FILTER_MS  80
-#define LVGL_TASK_MS        5
+#define LVGL_TASK_MS        5     // Minimum time between LVGL task loops
+#define LVGL_TASK_MAX_MS    500   // Longest LVGL task sleep
 
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void app_tasks_init(void);
 void gui_tasks_init(void);
+void gui_task_wake(void);
 void audio_tasks_init(void);
 void buzzer_task_init(void);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // APP_TASKS_H
@@ -13,29 +13,34 @@
 #define P_APP_GUI_WIDGET_n   (P1_APP | P2_GUI | P3_WIDGET | P3_ARR(0))
 
 // Instrument panel widgets
-#define W_INSTR_TACH_C      (P_APP_GUI_WIDGET_n | P3_ARR(0)) // Corner of tacho bar graph
-#define W_INSTR_TACH_V      (P_APP_GUI_WIDGET_n | P3_ARR(1)) // Vert bar of tacho bar graph
-#define W_INSTR_TACH_H      (P_APP_GUI_WIDGET_n | P3_ARR(2)) // Horiz bar of tacho bar graph
-#define W_INSTR_LBL_RPM     (P_APP_GUI_WIDGET_n | P3_ARR(3))
-//#define W_INSTR_OBJ_SPEED   (P_APP_GUI_WIDGET_n | P3_ARR(4))
-#define W_INSTR_LBL_SPEED   (P_APP_GUI_WIDGET_n | P3_ARR(5))
-#define W_INSTR_LBL_SPEED_UNIT (P_APP_GUI_WIDGET_n | P3_ARR(6))
-#define W_INSTR_GEAR_POS    (P_APP_GUI_WIDGET_n | P3_ARR(7))
-#define W_INSTR_GEAR_POS_IMG (P_APP_GUI_WIDGET_n | P3_ARR(8))
-#define W_INSTR_TILEVIEW    (P_APP_GUI_WIDGET_n | P3_ARR(9))
-#define W_INSTR_TILE1       (P_APP_GUI_WIDGET_n | P3_ARR(10))
-#define W_INSTR_TILE2       (P_APP_GUI_WIDGET_n | P3_ARR(11))
-#define W_INSTR_TILE3       (P_APP_GUI_WIDGET_n | P3_ARR(12))
-#define W_INSTR_DARK        (P_APP_GUI_WIDGET_n | P3_ARR(13))
-#define W_INSTR_STAND_ICON  (P_APP_GUI_WIDGET_n | P3_ARR(14))
-#define W_INSTR_SPRINT_ICON (P_APP_GUI_WIDGET_n | P3_ARR(15))
-#define W_INSTR_LBL_VOLTAGE       (P_APP_GUI_WIDGET_n | P3_ARR(16))
-#define W_INSTR_LBL_COOLANT_TEMP  (P_APP_GUI_WIDGET_n | P3_ARR(17))
-#define W_INSTR_LBL_FUEL          (P_APP_GUI_WIDGET_n | P3_ARR(18))
-#define W_INSTR_LBL_SPEED_AVG     (P_APP_GUI_WIDGET_n | P3_ARR(19))
-#define W_INSTR_LBL_SPEED_MAX     (P_APP_GUI_WIDGET_n | P3_ARR(20))
-#define W_INSTR_MENU        (P_APP_GUI_WIDGET_n | P3_ARR(100)) // Menu mode switch
-#define W_INSTR_MENU_PANE   (P_APP_GUI_WIDGET_n | P3_ARR(101))
+// Widget IDs index the dense object array in each UIPanel
+typedef enum {
+  W_INSTR_TACH_C = 0,     // Corner of tacho bar graph
+  W_INSTR_TACH_V,         // Vert bar of tacho bar graph
+  W_INSTR_TACH_H,         // Horiz bar of tacho bar graph
+  W_INSTR_LBL_RPM,
+  W_INSTR_LBL_SPEED,
+  W_INSTR_LBL_SPEED_UNIT,
+  W_INSTR_GEAR_POS,
+  W_INSTR_GEAR_POS_IMG,
+  W_INSTR_TILEVIEW,
+  W_INSTR_TILE1,
+  W_INSTR_TILE2,
+  W_INSTR_TILE3,
+  W_INSTR_DARK,
+  W_INSTR_STAND_ICON,
+  W_INSTR_SPRINT_ICON,
+  W_INSTR_LBL_VOLTAGE,
+  W_INSTR_LBL_COOLANT_TEMP,
+  W_INSTR_LBL_FUEL,
+  W_INSTR_LBL_SPEED_AVG,
+  W_INSTR_LBL_SPEED_MAX,
+  W_INSTR_MENU,           // Menu mode switch
+  W_INSTR_MENU_PANE,
+  W_INSTR_TACH_C_IND,     // Sprite indicator for tacho corner
+
+  W_INSTR_COUNT
+} InstrWidgetId;
 
 // Menu items
 #define P_APP_GUI_MENU_n  (P1_APP | P2_GUI | P3_MENU | P3_ARR(0))
@@ -66,6 +71,13 @@
 #define P_APP_GUI_UNITS__TEMPERATURE (P1_APP | P2_GUI | P3_UNITS | P3_ARR(1))
 #define P_APP_GUI_MENU__MODE        (P_APP_GUI_MENU_n | P3_ARR(0))
 
+// GUI profiler averages, updated once per second
+#define P_APP_GUI_PROFILE__RENDER   (P1_APP | P2_GUI | P3_PROFILE | P4_RENDER)  // us per lv_timer_handler()
+#define P_APP_GUI_PROFILE__PIXELS   (P1_APP | P2_GUI | P3_PROFILE | P4_PIXELS)  // Flushed px per frame
+#define P_APP_GUI_PROFILE__AREAS    (P1_APP | P2_GUI | P3_PROFILE | P4_AREAS)   // Invalidated areas per frame
+#define P_APP_GUI_PROFILE__HANDLER  (P1_APP | P2_GUI | P3_PROFILE | P4_HANDLER) // Prop handler us per interval
+#define P_APP_GUI_PROFILE__FPS      (P1_APP | P2_GUI | P3_PROFILE | P4_FPS)
+
 #define P_SENSOR_ECU_n_MSK                (P1_SENSOR | P2_ECU | P2_ARR(0) | P3_MSK | P4_MSK)
 #define P_SENSOR_ECU_n_VALUE              (P1_SENSOR | P2_ECU | P2_ARR(0) | P4_VALUE)
 #define P_SENSOR_ECU__SPEED__VALUE        (P1_SENSOR | P2_ECU | P2_ARR(0) | P4_VALUE)
@@ -118,12 +130,20 @@ extern TouchState g_touch_state;
 extern TouchCalibration g_touch_cal;
 extern PropDB g_prop_db;
 
+struct UMsgBatchRouter;
+struct UMsgBatchTarget;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void gui_prop_msg_handler(UMsgTarget *tgt, UMsg *msg);
+void gui_prop_batch_init(struct UMsgBatchRouter *router, struct UMsgBatchTarget *btgt);
+void gui_prop_batch_handler(struct UMsgBatchTarget *btgt, UMsg *msgs, unsigned msg_count);
 void gui_prop_init(void);
+unsigned gui_prop_drain(void);
+void gui_refr_monitor(lv_disp_drv_t *disp_drv, uint32_t time, uint32_t px);
+int32_t cmd_frame(uint8_t argc, char *argv[], void *eval_ctx);
 
 lv_theme_t *set_theme_mode(lv_disp_t *disp, bool dark_mode);
 void app_styles_init(void);
@@ -131,6 +151,7 @@ void app_screens_init(void);
 
 
 void update_tacho(uint16_t rpm);
+bool gui_tacho_sprites_active(void);
 void update_sidestand(bool down);
 void update_gear_pos(uint32_t gear);
 void update_gui_menu_mode(uint32_t mode);
@@ -15,7 +15,8 @@ typedef enum {
   OSC_SQUARE,
   OSC_SAWTOOTH,
   OSC_TRIANGLE,
-  OSC_NOISE
+  OSC_NOISE,
+  OSC_SAMPLE    // PCM from a SynthStream
 } OscKind;
 
 typedef struct {
@@ -76,6 +77,7 @@ typedef struct {
   OscKind   kind;
 
   SynthDDFS ddfs;
+  struct SynthStream *stream; // Sample source for OSC_SAMPLE
   int16_t   output;
   uint8_t   prev_quadrant : 2;
   uint8_t   quadrant      : 2;
@@ -132,6 +134,7 @@ typedef struct {
   SynthVoiceCfg instruments[SYNTH_MAX_INSTRUMENTS];
 
   IQueue_int16_t *queue;
+  struct SynthStream *pending_stream; // Started on a voice by the render loop
   int16_t    *next_buf;
   uint32_t    timestamp;
   uint32_t    sample_count;
@@ -302,6 +305,7 @@ void synth_instrument_init(SynthState *synth, int inst, SynthVoiceCfg *cfg);
 int synth_instrument_add(SynthState *synth, SynthVoiceCfg *cfg);
 
 SynthVoice *synth_add_voice(SynthState *synth, uint8_t key, int inst);
+bool synth_add_stream_voice(SynthState *synth, struct SynthStream *stream);
 //void synth_end_voice(SynthState *synth, uint8_t key);
 void synth_press_key(SynthState *synth, uint8_t key, int inst);
 void synth_release_key(SynthState *synth, uint8_t key, int inst);
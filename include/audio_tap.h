@@ -0,0 +1,46 @@
+#ifndef AUDIO_TAP_H
+#define AUDIO_TAP_H
+
+// Samples collected in the render loop before each copy into the ring
+#define AUDIO_TAP_BLOCK_SAMPLES   64
+
+typedef enum {
+  TAP_IDLE = 0,
+  TAP_ACTIVE,
+  TAP_STOPPING
+} AudioTapState;
+
+typedef enum {
+  TAP_SINK_WAV = 0,
+  TAP_SINK_RAW,
+  TAP_SINK_CONSOLE
+} AudioTapSink;
+
+typedef struct {
+  uint32_t  captured;   // Samples written to the sink
+  uint32_t  dropped;    // Samples lost to a full ring
+  AudioTapState state;
+} AudioTapStats;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern volatile AudioTapState g_audio_tap_state;
+
+static inline bool audio_tap_active(void) {
+  return g_audio_tap_state == TAP_ACTIVE;
+}
+
+void audio_tap_write(const int16_t *samples, size_t count);
+bool audio_tap_start(AudioTapSink sink, const char *path, uint32_t sample_rate);
+void audio_tap_stop(void);
+void audio_tap_stats(AudioTapStats *stats);
+void audio_tap_task_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AUDIO_TAP_H
@@ -9,6 +9,7 @@ extern "C" {
 
 void set_nav_button_state(uint32_t event);
 void nav_input_read(lv_indev_drv_t *drv, lv_indev_data_t *data);
+void gui_input_resume(void);
 
 bool ts_load_calibration(TouchCalibration *touch_cal);
 bool ts_set_calibration(TouchCalPoint *p0, TouchCalPoint *p1);
@@ -17,8 +18,11 @@ int32_t cmd_tscal(uint8_t argc, char *argv[], void *eval_ctx);
 #ifdef PLATFORM_EMBEDDED
 void lvgl_stm32_init(void);
 void lcd_init(void);
+void lcd_dma2d_irq(void);
 #else
 void lvgl_sim_init(void);
+void lvgl_headless_init(void);
+uint32_t lvgl_headless_checksum(void);
 #endif
 
 #ifdef __cplusplus
@@ -0,0 +1,52 @@
+#ifndef GUI_PROFILE_H
+#define GUI_PROFILE_H
+
+#define GUI_PROF_MAX_PROPS    16
+#define GUI_PROF_PUBLISH_MS   1000  // Interval for props and overlay updates
+
+typedef struct {
+  uint32_t  prop;
+  uint32_t  calls;
+  uint32_t  total_us;
+  uint32_t  max_us;
+} GuiPropProfile;
+
+typedef struct {
+  uint32_t  loops;            // lv_timer_handler() calls
+  uint32_t  render_total_us;  // Time in lv_timer_handler()
+  uint32_t  render_max_us;
+  uint32_t  frames;           // Refreshes that flushed to the display
+  uint32_t  refr_total_ms;    // Refresh times from the display monitor callback
+  uint32_t  refr_max_ms;
+  uint32_t  flush_px;         // Flushed pixel area
+  uint32_t  flush_areas;      // Invalidated regions after joining
+  uint32_t  flush_wait_us;    // Time LVGL blocked waiting on flushes
+  uint32_t  handler_total_us; // Time in gui_prop_msg_handler()
+  uint32_t  untracked;        // Handler calls for props beyond table capacity
+  uint16_t  prop_count;
+  GuiPropProfile props[GUI_PROF_MAX_PROPS];
+} GuiProfile;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Start times are from elapsed_mark()
+void gui_profile_render(uint32_t start);
+void gui_profile_refr(uint32_t time_ms);
+void gui_profile_flush(lv_disp_drv_t *disp_drv, const lv_area_t *area);
+void gui_profile_flush_wait(uint32_t start);
+void gui_profile_handler(uint32_t prop, uint32_t start);
+
+void gui_profile_reset(void);
+void gui_profile_show_overlay(bool show);
+bool gui_profile_overlay_shown(void);
+void gui_profile_get(GuiProfile *prof);
+void gui_profile_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GUI_PROFILE_H
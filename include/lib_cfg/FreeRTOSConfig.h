@@ -137,6 +137,7 @@ to exclude the API function. */
 #define INCLUDE_vTaskDelay              1
 #define INCLUDE_xTaskAbortDelay         1
 #define INCLUDE_xTaskGetIdleTaskHandle  1
+#define INCLUDE_xTaskGetSchedulerState  1
 
 #ifdef PLATFORM_EMBEDDED
 
@@ -0,0 +1,18 @@
+#ifndef LV_TICK_SRC_H
+#define LV_TICK_SRC_H
+
+#include <stdint.h>
+
+// LVGL tick source. Defined by the app so LVGL doesn't need the RTOS headers.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t gui_tick_ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LV_TICK_SRC_H
@@ -0,0 +1,21 @@
+#ifndef LOG_COMPRESS_H
+#define LOG_COMPRESS_H
+
+// Heatshrink parameters for log records. Records are small so a short window
+// keeps the encoder state within a few hundred bytes of RAM.
+#define LOG_COMPRESS_WINDOW_SZ2     8
+#define LOG_COMPRESS_LOOKAHEAD_SZ2  4
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ptrdiff_t log_compress(const uint8_t *src, size_t src_len, uint8_t *dest, size_t dest_size);
+ptrdiff_t log_decompress(const uint8_t *src, size_t src_len, uint8_t *dest, size_t dest_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOG_COMPRESS_H
@@ -1,11 +1,30 @@
 #ifndef LOG_EVFS_H
 #define LOG_EVFS_H
 
+#define LOG_EVFS_PAGE_SIZE  512   // Must be power of 2
+
+// Context for Log DB storage in an EVFS file
+typedef struct {
+  EvfsFile *fh;
+  size_t    file_size;
+  SemaphoreHandle_t lock;
+  StaticSemaphore_t lock_buf;
+
+  // Write-back page cache
+  size_t    page_start;
+  bool      page_valid;
+  bool      page_dirty;
+  uint8_t   page[LOG_EVFS_PAGE_SIZE];
+} LogEvfs;
+
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+bool log_evfs_init(LogEvfs *le, EvfsFile *fh, size_t log_size);
+bool log_evfs_sync(void *ctx);
+
 void log_evfs_erase_sector(void *ctx, size_t sector_start, size_t sector_size);
 bool log_evfs_read_block(void *ctx, size_t block_start, uint8_t *dest, size_t block_size);
 bool log_evfs_write_block(void *ctx, size_t block_start, uint8_t *src, size_t block_size);
@@ -0,0 +1,28 @@
+#ifndef LOG_MMAP_H
+#define LOG_MMAP_H
+
+// Context for Log DB storage in a memory mapped file
+typedef struct {
+  uint8_t  *base;
+  size_t    size;
+  int       fd;
+} LogMmap;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool log_mmap_open(LogMmap *lm, const char *path, size_t size);
+void log_mmap_close(LogMmap *lm);
+bool log_mmap_sync(void *ctx);
+
+void log_mmap_erase_sector(void *ctx, size_t sector_start, size_t sector_size);
+bool log_mmap_read_block(void *ctx, size_t block_start, uint8_t *dest, size_t block_size);
+bool log_mmap_write_block(void *ctx, size_t block_start, uint8_t *src, size_t block_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOG_MMAP_H
@@ -0,0 +1,44 @@
+#ifndef PROP_PERSIST_H
+#define PROP_PERSIST_H
+
+// Commit any buffered writes in the LogDB storage backend
+typedef bool (*PropPersistSync)(void *ctx);
+
+typedef struct {
+  PropDB     *db;
+  LogDB      *log_db;
+  TickType_t  window;       // Quiet time before a flush
+  TickType_t  max_delay;    // Limit on time a change can stay pending
+  TickType_t  first_change;
+  TickType_t  last_change;
+  bool        pending;
+  PropPersistSync sync_storage;
+  void       *sync_ctx;
+  SemaphoreHandle_t lock;
+  StaticSemaphore_t lock_buf;
+
+  // Stats
+  uint32_t    changes;      // Change batches observed
+  uint32_t    coalesced;    // Changes merged into an already pending flush
+  uint32_t    flushes;      // LogDB records written
+  uint32_t    failures;     // Flushes that failed to write or sync
+} PropPersist;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void prop_persist_init(PropPersist *pp, PropDB *db, LogDB *log_db, uint32_t window_ms,
+                       uint32_t max_delay_ms);
+void prop_persist_set_sync(PropPersist *pp, PropPersistSync sync_storage, void *sync_ctx);
+void prop_persist_start(PropPersist *pp, uint32_t poll_ms);
+void prop_persist_poll(PropPersist *pp);
+bool prop_persist_flush(PropPersist *pp);
+bool prop_persist_try_flush(PropPersist *pp, TickType_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROP_PERSIST_H
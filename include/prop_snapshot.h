@@ -0,0 +1,36 @@
+#ifndef PROP_SNAPSHOT_H
+#define PROP_SNAPSHOT_H
+
+typedef struct {
+  volatile uint32_t seq;      // Odd while an update is in progress
+  volatile uint32_t value;
+} PropSnapshotSlot;
+
+
+// Map prop ID to snapshot slot. Returns -1 for props not in the snapshot.
+typedef int (*PropSnapshotSlotOf)(uint32_t prop);
+
+typedef struct {
+  UMsgTarget          tgt;  // Receives prop change messages. Must be first member.
+  const uint32_t     *props;
+  PropSnapshotSlot   *slots;
+  unsigned            prop_count;
+  PropSnapshotSlotOf  slot_of;
+} PropSnapshot;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void prop_snapshot_init(PropSnapshot *ps, const uint32_t *props, PropSnapshotSlot *slots,
+                        unsigned prop_count, PropSnapshotSlotOf slot_of, PropDB *db, UMsgHub *hub);
+int prop_snapshot_slot(PropSnapshot *ps, uint32_t prop);
+void prop_snapshot_set_slot(PropSnapshot *ps, unsigned slot, uint32_t value);
+uint32_t prop_snapshot_read_slot(PropSnapshot *ps, unsigned slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROP_SNAPSHOT_H
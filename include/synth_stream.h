@@ -0,0 +1,70 @@
+#ifndef SYNTH_STREAM_H
+#define SYNTH_STREAM_H
+
+// Each stream has two buffers of this size. At 16kHz a buffer covers 32ms of
+// playback which sets the latency the filler task can tolerate.
+#define SYNTH_STREAM_BUF_SAMPLES  512
+#define SYNTH_MAX_STREAMS         1
+
+typedef struct {
+  int16_t   samples[SYNTH_STREAM_BUF_SAMPLES];
+  uint16_t  count;  // Valid samples. 0 when free for the filler.
+} SynthStreamBuf;
+
+// Double buffered PCM stream feeding an OSC_SAMPLE voice. The filler task owns
+// empty buffers and the render loop owns full buffers. Ownership passes by
+// writing the count field.
+typedef struct SynthStream {
+  SynthStreamBuf  bufs[2];
+  uint32_t  phase;      // 16.16 fixed point position within the play buffer
+  uint32_t  step;       // 16.16 fixed point file samples per output sample
+  uint32_t  data_remain;  // Bytes left in file
+  uint32_t  underruns;  // Output samples with no buffered data
+  int8_t    voice;      // Voice playing this stream. -1 until the render loop starts it.
+  uint8_t   play_buf;   // Buffer being consumed by the render loop
+  uint8_t   fill_buf;   // Next buffer for the filler
+  uint8_t   sample_bytes; // 1 = unsigned 8-bit, 2 = signed 16-bit
+  bool      eof;        // All file data has been buffered
+  bool      finished;   // Render loop has played all data
+} SynthStream;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Next output sample from the render loop. Never blocks. Returns silence if the
+// filler has fallen behind.
+static inline int16_t synth_stream_next(SynthStream *stream) {
+  SynthStreamBuf *buf = &stream->bufs[stream->play_buf];
+  uint16_t count = __atomic_load_n(&buf->count, __ATOMIC_ACQUIRE);
+
+  if(count == 0) {
+    if(__atomic_load_n(&stream->eof, __ATOMIC_ACQUIRE))
+      stream->finished = true;
+    else
+      stream->underruns++;
+    return 0;
+  }
+
+  unsigned pos = stream->phase >> 16;
+  int16_t sample = pos < count ? buf->samples[pos] : 0;
+
+  stream->phase += stream->step;
+  if((stream->phase >> 16) >= count) {  // Return buffer to the filler
+    stream->phase -= (uint32_t)count << 16;
+    __atomic_store_n(&buf->count, 0, __ATOMIC_RELEASE);
+    stream->play_buf ^= 1;
+  }
+
+  return sample;
+}
+
+SynthStream *synth_play_file(SynthState *synth, const char *path);
+void synth_stream_task_init(SynthState *synth);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SYNTH_STREAM_H
@@ -0,0 +1,22 @@
+#ifndef TACH_SPRITE_H
+#define TACH_SPRITE_H
+
+// Tacho corner arc is one quadrant of a circle this radius
+#define TACH_SPRITE_SIZE    40
+#define TACH_SPRITE_STEPS   101   // One frame per percent
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool tach_sprite_init(lv_coord_t arc_width, lv_color_t ind_color, lv_color_t track_color);
+lv_obj_t *tach_sprite_create(lv_obj_t *parent);
+void tach_sprite_set_value(lv_obj_t *obj, unsigned pct);
+void tach_sprite_set_track_color(lv_obj_t *obj, lv_color_t color);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TACH_SPRITE_H
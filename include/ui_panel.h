@@ -1,9 +1,14 @@
 #ifndef UI_PANEL_H
 #define UI_PANEL_H
 
+// Cached value for widgets that haven't been rendered
+#define UI_VALUE_NONE   INT32_MIN
+
 typedef struct {
-  lv_obj_t *screen;
-  dhash     hash;
+  lv_obj_t  *screen;
+  lv_obj_t **objs;      // Widgets indexed by panel specific ID enum
+  int32_t   *values;    // Last rendered display value per widget
+  uint16_t   obj_count;
 } UIPanel;
 
 
@@ -18,19 +23,23 @@ typedef struct {
 } UIWidgetRegistry;
 
 
+typedef void (*UIWidgetUpdate)(lv_obj_t *widget, uint32_t prop);
+
 typedef struct {
-  void (*update_widget)(lv_obj_t *widget, uint32_t prop);
+  UIWidgetUpdate update_widget;
 } UIWidgetEntry;
 
 
 typedef struct UIReactWidgetNode {
   struct UIReactWidgetNode *next;
   lv_obj_t *widget;
+  UIWidgetUpdate update_widget; // Cached from registry at bind time
 } UIReactWidgetNode;
 
 
 typedef struct {
-  dhash hash;
+  dhash     hash;
+  uint32_t  prop_filter;  // Skips hash lookup for props that were never bound
 } UIReactWidgets;
 
 
@@ -39,10 +48,28 @@ typedef struct {
 extern "C" {
 #endif
 
-bool ui_panel_init(UIPanel *panel);
+bool ui_panel_init(UIPanel *panel, uint16_t obj_count);
 void ui_panel_free(UIPanel *panel);
-bool ui_panel_add_obj(UIPanel *panel, uint32_t id, lv_obj_t *obj);
-lv_obj_t *ui_panel_get_obj(UIPanel *panel, uint32_t id);
+bool ui_panel_add_obj(UIPanel *panel, unsigned id, lv_obj_t *obj);
+
+static inline lv_obj_t *ui_panel_get_obj(UIPanel *panel, unsigned id) {
+  return id < panel->obj_count ? panel->objs[id] : NULL;
+}
+
+// Record a quantized display value. Returns false if the widget already shows it.
+static inline bool ui_panel_value_changed(UIPanel *panel, unsigned id, int32_t value) {
+  if(id >= panel->obj_count || panel->values[id] == value)
+    return false;
+
+  panel->values[id] = value;
+  return true;
+}
+
+// Force next update to render. Use when a widget is changed outside the cache.
+static inline void ui_panel_value_reset(UIPanel *panel, unsigned id) {
+  if(id < panel->obj_count)
+    panel->values[id] = UI_VALUE_NONE;
+}
 
 bool ui_styles_init(UIStyles *styles);
 void ui_styles_free(UIStyles *styles);
@@ -57,9 +84,9 @@ void ui_widget_reg_add_defaults(UIWidgetRegistry *wreg);
 
 bool ui_react_widgets_init(UIReactWidgets *rw);
 void ui_react_widgets_free(UIReactWidgets *rw);
-bool ui_react_widgets_bind(UIReactWidgets *rw, uint32_t prop, lv_obj_t *widget);
+bool ui_react_widgets_bind(UIReactWidgets *rw, UIWidgetRegistry *wreg, uint32_t prop, lv_obj_t *widget);
 UIReactWidgetNode *ui_react_widgets_get(UIReactWidgets *rw, uint32_t prop);
-void ui_react_widgets_update(UIReactWidgets *rw, UIWidgetRegistry *wreg, uint32_t prop);
+void ui_react_widgets_update(UIReactWidgets *rw, uint32_t prop);
 
 bool ui_panel_push(UIPanel *panel);
 UIPanel *ui_panel_pop(void);
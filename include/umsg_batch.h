@@ -0,0 +1,95 @@
+#ifndef UMSG_BATCH_H
+#define UMSG_BATCH_H
+
+#define UMSG_BATCH_MAX_TARGETS    8
+#define UMSG_BATCH_MAX_FILTERS    16
+#define UMSG_BATCH_INDEX_SLOTS    16  // Must be power of 2
+#define UMSG_BATCH_QUEUE_SIZE     32
+#define UMSG_COALESCE_MAX_PROPS   32
+
+
+// Last-value-wins storage for high rate props. Consumers drain the
+// latest message for each dirty prop at their own pace.
+typedef void (*UMsgCoalesceHandler)(UMsgTarget *tgt, UMsg *msg);
+
+typedef struct {
+  const uint32_t   *props;      // Coalesced prop IDs
+  UMsg             *latest;     // Most recent message for each prop
+  unsigned          prop_count;
+  volatile uint32_t dirty;      // Bit set of props with an undelivered message
+  uint32_t          coalesced;  // Count of messages replaced before delivery
+} UMsgCoalesce;
+
+
+typedef struct UMsgBatchTarget UMsgBatchTarget;
+
+// Callback invoked once per drain with all messages that matched the target
+typedef void (*UMsgBatchHandler)(UMsgBatchTarget *btgt, UMsg *msgs, unsigned msg_count);
+
+struct UMsgBatchTarget {
+  UMsgBatchHandler handler;
+  void            *ctx;
+  UMsgCoalesce    *coalesce;  // Optional props kept as latest value instead of queued
+};
+
+
+typedef struct {
+  uint32_t filter;
+  uint8_t  target;    // Index into UMsgBatchRouter.targets
+} UMsgBatchFilter;
+
+typedef struct {
+  uint32_t prefix;      // P1|P2 fields of filter
+  uint16_t filter_set;  // Bit set of UMsgBatchRouter.filters with this prefix
+} UMsgBatchIndexSlot;
+
+typedef struct {
+  UMsg    msg;
+  uint8_t target_set;   // Bit set of targets matching this message
+} UMsgBatchPending;
+
+
+typedef struct UMsgBatchRouter {
+  UMsgTarget          tgt;  // Callback target subscribed to hub. Must be first member.
+
+  UMsgBatchTarget    *targets[UMSG_BATCH_MAX_TARGETS];
+  UMsgBatchFilter     filters[UMSG_BATCH_MAX_FILTERS];
+  UMsgBatchIndexSlot  index[UMSG_BATCH_INDEX_SLOTS];
+  uint16_t            wild_filters; // Filters with masked P1 or P2 field
+  uint8_t             target_count;
+  uint8_t             filter_count;
+
+  // Messages queued from hub context. Coalesced props bypass the queue.
+  UMsgBatchPending    pending[UMSG_BATCH_QUEUE_SIZE];
+  unsigned            pending_count;
+  uint32_t            dropped;
+
+  // Messages owned by the delivery task
+  UMsgBatchPending    draining[UMSG_BATCH_QUEUE_SIZE];
+  UMsg                batch[UMSG_BATCH_QUEUE_SIZE + UMSG_COALESCE_MAX_PROPS];
+
+  TaskHandle_t        task;
+} UMsgBatchRouter;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void umsg_batch_init(UMsgBatchRouter *router, UMsgHub *hub);
+bool umsg_batch_add_target(UMsgBatchRouter *router, UMsgBatchTarget *btgt, UMsgBatchHandler handler,
+                           void *ctx);
+bool umsg_batch_add_filter(UMsgBatchRouter *router, UMsgBatchTarget *btgt, uint32_t filter);
+void umsg_batch_set_coalesce(UMsgBatchTarget *btgt, UMsgCoalesce *co);
+bool umsg_batch_start(UMsgBatchRouter *router, UBaseType_t priority);
+void umsg_batch_drain(UMsgBatchRouter *router);
+
+bool umsg_coalesce_init(UMsgCoalesce *co, const uint32_t *props, UMsg *latest, unsigned prop_count);
+bool umsg_coalesce_put(UMsgCoalesce *co, UMsg *msg);
+unsigned umsg_coalesce_drain(UMsgCoalesce *co, UMsgCoalesceHandler handler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UMSG_BATCH_H
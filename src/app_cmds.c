@@ -2,6 +2,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "lib_cfg/build_config.h"
 #ifdef PLATFORM_STM32F4
@@ -25,7 +26,11 @@
 #include "app_cmds.h"
 #include "cstone/prop_id.h"
 #include "cstone/prop_db.h"
+#include "cstone/log_db.h"
 #include "app_prop_id.h"
+#include "prop_persist.h"
+#include "log_compress.h"
+#include "app_prop_slots.h"
 
 
 #include "util/term_color.h"
@@ -43,6 +48,10 @@
 #  include "sample_device.h"
 #  include "audio_synth.h"
 #  include "cstone/sequence_events.h"
+#  include "audio_tap.h"
+#  if USE_FILESYSTEM
+#    include "synth_stream.h"
+#  endif
 #endif
 
 #ifdef USE_CRON
@@ -52,6 +61,9 @@
 #if USE_LVGL && defined PLATFORM_EMBEDDED
 extern int32_t cmd_tscal(uint8_t argc, char *argv[], void *eval_ctx);
 #endif
+#if USE_LVGL && USE_GUI_PROFILE
+extern int32_t cmd_frame(uint8_t argc, char *argv[], void *eval_ctx);
+#endif
 
 static int32_t cmd_demo(uint8_t argc, char *argv[], void *eval_ctx) {
   printf("  argv[0]  %s\n", argv[0]);
@@ -63,6 +75,14 @@ static int32_t cmd_demo(uint8_t argc, char *argv[], void *eval_ctx) {
 }
 
 
+// Reset after saving pending prop changes
+static int32_t cmd_restart(uint8_t argc, char *argv[], void *eval_ctx) {
+  puts("Restarting");
+  app_restart();
+  return 0;
+}
+
+
 #if USE_AUDIO
 
 static void key__input_redirect(Console *con, KeyCode key_code, void *eval_ctx) {
@@ -420,9 +440,140 @@ static int32_t cmd_rcc(uint8_t argc, char *argv[], void *eval_ctx) {
 }
 #endif // PLATFORM_STM32F4
 
-#if USE_AUDIO
+extern PropPersist g_prop_persist;
 extern PropDB g_prop_db;
 
+static int32_t cmd_persist(uint8_t argc, char *argv[], void *eval_ctx) {
+  GetoptState state = {0};
+  state.report_errors = true;
+  int c;
+
+  bool flush = false;
+
+  while((c = getopt_r(argv, "fh", &state)) != -1) {
+    switch(c) {
+    case 'f': flush = true; break;
+
+    case 'h':
+      puts("persist [-f] [-h]");
+      return 0;
+      break;
+
+    default:
+    case ':':
+    case '?':
+      return -3;
+      break;
+    }
+  }
+
+  PropPersist *pp = &g_prop_persist;
+
+  if(flush) {
+    uint32_t failures = pp->failures;
+    if(prop_persist_flush(pp))
+      puts("Props saved");
+    else if(pp->failures != failures)
+      puts("Save failed");
+    else
+      puts("Nothing to save");
+  }
+
+  printf("  Pending:   %s\n", pp->pending ? "yes" : "no");
+  printf("  Changes:   %" PRIu32 "\n", pp->changes);
+  printf("  Coalesced: %" PRIu32 "\n", pp->coalesced);
+  printf("  Flushes:   %" PRIu32 "\n", pp->flushes);
+  printf("  Failures:  %" PRIu32 "\n", pp->failures);
+
+  return 0;
+}
+
+
+// Benchmark heatshrink on a record of the props with fixed slots
+static int32_t cmd_logz(uint8_t argc, char *argv[], void *eval_ctx) {
+  GetoptState state = {0};
+  state.report_errors = true;
+  int c;
+
+  unsigned iterations = 100;
+
+  while((c = getopt_r(argv, "n:h", &state)) != -1) {
+    switch(c) {
+    case 'n': iterations = strtoul(state.optarg, NULL, 0); break;
+
+    case 'h':
+      puts("logz [-n <iterations>] [-h]");
+      puts("  Compress and expand a record of the slot props with log_compress().");
+      puts("  Reports the ratio and the time per record from the profiler.");
+      return 0;
+      break;
+
+    default:
+    case ':':
+    case '?':
+      return -3;
+      break;
+    }
+  }
+
+  if(iterations == 0)
+    iterations = 1;
+
+  // Serialize props as ID, value pairs
+  static const uint32_t s_record_props[] = {
+    PROP_SLOTS_APP(PROP_SLOT_ID_ITEM)
+  };
+  static uint32_t s_record[COUNT_OF(s_record_props) * 2];
+  static uint8_t s_packed[sizeof(s_record) + sizeof(s_record)/8 + 8];
+  static uint32_t s_unpacked[COUNT_OF(s_record)];
+
+  for(unsigned i = 0; i < COUNT_OF(s_record_props); i++) {
+    PropDBEntry entry = {0};
+    prop_get(&g_prop_db, s_record_props[i], &entry);
+    s_record[i*2]   = s_record_props[i];
+    s_record[i*2+1] = entry.value;
+  }
+
+  static uint32_t s_comp_id, s_decomp_id;
+  static bool s_profiles_added = false;
+  if(!s_profiles_added) {
+    s_comp_id = profile_add(0, "logz compress");
+    s_decomp_id = profile_add(0, "logz decompress");
+    s_profiles_added = true;
+  }
+
+  ptrdiff_t packed_len = 0;
+  ptrdiff_t unpacked_len = 0;
+
+  for(unsigned i = 0; i < iterations; i++) {
+    profile_start(s_comp_id);
+    packed_len = log_compress((uint8_t *)s_record, sizeof(s_record), s_packed, sizeof(s_packed));
+    profile_stop(s_comp_id);
+    if(packed_len < 0)
+      break;
+
+    profile_start(s_decomp_id);
+    unpacked_len = log_decompress(s_packed, packed_len, (uint8_t *)s_unpacked,
+                                  sizeof(s_unpacked));
+    profile_stop(s_decomp_id);
+  }
+
+  if(packed_len < 0 || unpacked_len != sizeof(s_record) ||
+      memcmp(s_record, s_unpacked, sizeof(s_record))) {
+    puts(A_BRED "Round trip failed" A_NONE);
+    return -4;
+  }
+
+  printf("  Record:     %u bytes\n", (unsigned)sizeof(s_record));
+  printf("  Compressed: %u bytes (%u%%)\n", (unsigned)packed_len,
+          (unsigned)(packed_len * 100 / sizeof(s_record)));
+  profile_report_all();
+
+  return 0;
+}
+
+
+#if USE_AUDIO
 static int32_t cmd_audio(uint8_t argc, char *argv[], void *eval_ctx) {
   GetoptState state = {0};
   state.report_errors = true;
@@ -430,18 +581,20 @@ static int32_t cmd_audio(uint8_t argc, char *argv[], void *eval_ctx) {
 
   const char *mode = NULL;
   const char *wave = NULL;
+  const char *play_file = NULL;
   int32_t frequency = -1;
   int curve = -1;
 
-  while((c = getopt_r(argv, "f:m:w:c:h", &state)) != -1) {
+  while((c = getopt_r(argv, "f:m:w:c:p:h", &state)) != -1) {
     switch(c) {
     case 'f': frequency = strtol(state.optarg, NULL, 10); break;
     case 'm': mode = state.optarg; break;
     case 'w': wave = state.optarg; break;
     case 'c': curve = strtol(state.optarg, NULL, 10); break;
+    case 'p': play_file = state.optarg; break;
 
     case 'h':
-      puts("audio [-m on|off] [-f freq] [-w sin|sqr|saw|tri] [-h]");
+      puts("audio [-m on|off] [-f freq] [-w sin|sqr|saw|tri] [-p <wav file>] [-h]");
       return 0;
       break;
 
@@ -489,6 +642,78 @@ static int32_t cmd_audio(uint8_t argc, char *argv[], void *eval_ctx) {
       printf("ERROR: Unknown wave kind: '%s'\n", wave);
   }
 
+  if(play_file) {
+#  if USE_FILESYSTEM
+    extern SynthState g_audio_synth;
+    extern SampleDevice *g_dev_audio;
+
+    if(synth_play_file(&g_audio_synth, play_file))
+      sdev_ctl(g_dev_audio, SDEV_OP_ACTIVATE, NULL, 0);
+    else
+      printf("ERROR: Can't play '%s'\n", play_file);
+#  else
+    puts("ERROR: No filesystem");
+#  endif
+  }
+
+  return 0;
+}
+
+
+static int32_t cmd_tap(uint8_t argc, char *argv[], void *eval_ctx) {
+  GetoptState state = {0};
+  state.report_errors = true;
+  int c;
+
+  const char *path = NULL;
+  AudioTapSink sink = TAP_SINK_WAV;
+  bool console = false;
+  bool stop = false;
+
+  while((c = getopt_r(argv, "f:rcsh", &state)) != -1) {
+    switch(c) {
+    case 'f': path = state.optarg; break;
+    case 'r': sink = TAP_SINK_RAW; break;
+    case 'c': console = true; break;
+    case 's': stop = true; break;
+
+    case 'h':
+      puts("tap [-f <file> [-r]] [-c] [-s] [-h]");
+      puts("  Capture the audio mix to a WAV file, raw PCM (-r), or console hex (-c)");
+      puts("  -s stops capture. No options shows status.");
+      return 0;
+      break;
+
+    default:
+    case ':':
+    case '?':
+      return -3;
+      break;
+    }
+  }
+
+  if(stop) {
+    audio_tap_stop();
+    return 0;
+  }
+
+  if(path || console) {
+    if(console)
+      sink = TAP_SINK_CONSOLE;
+
+    if(!audio_tap_start(sink, path, AUDIO_SAMPLE_RATE)) {
+      puts("ERROR: Can't start tap");
+      return -4;
+    }
+    return 0;
+  }
+
+  static const char *s_state_names[] = {"idle", "active", "stopping"};
+  AudioTapStats stats;
+  audio_tap_stats(&stats);
+  printf("Tap %s: %" PRIu32 " captured, %" PRIu32 " dropped\n", s_state_names[stats.state],
+         stats.captured, stats.dropped);
+
   return 0;
 }
 #endif
@@ -609,11 +834,18 @@ const ConsoleCommandDef g_app_cmd_set[] = {
 #if USE_LVGL && defined PLATFORM_EMBEDDED
   CMD_DEF("tscal",    cmd_tscal,      "TS calibrate"),
 #endif
+#if USE_LVGL && USE_GUI_PROFILE
+  CMD_DEF("frame",    cmd_frame,      "GUI frame times"),
+#endif
 #if USE_AUDIO
   CMD_DEF("audio",    cmd_audio,      "Sound control"),
+  CMD_DEF("tap",      cmd_tap,        "Capture audio output"),
   CMD_DEF("key",      cmd_key,        "Play key"),
   CMD_DEF("SEQuence", cmd_sequence,   "Play sequence"),
 #endif
+  CMD_DEF("persist",  cmd_persist,    "Prop persistence"),
+  CMD_DEF("restart",  cmd_restart,    "Save props and reset"),
+  CMD_DEF("logz",     cmd_logz,       "Log compression benchmark"),
   CMD_DEF("PROFile",  cmd_profile,    "Profile stats"),
 #ifdef PLATFORM_STM32F4
   CMD_DEF("rcc",      cmd_rcc,        "Debug RCC"),
@@ -36,9 +36,12 @@
 #    endif
 #  endif
 #  include "cstone/cycle_counter_cortex.h"
+#else
+#  include <time.h>
 #endif
 
 #include "FreeRTOS.h"
+#include "task.h"
 #include "semphr.h"
 #include "queue.h"
 #include "cstone/obj_metadata.h"
@@ -52,6 +55,9 @@
 #include "cstone/sequence_events.h"
 #include "cstone/umsg.h"
 #include "cstone/tasks_core.h"
+#include "umsg_batch.h"
+#include "prop_snapshot.h"
+#include "prop_persist.h"
 #include "cstone/prop_id.h"
 #include "app_prop_id.h"
 #include "cstone/iqueue_int16_t.h"
@@ -63,7 +69,10 @@
 #if !LOG_TO_RAM
 #  ifdef PLATFORM_EMBEDDED
 #    include "cstone/log_stm32.h"
+#  elif LOG_TO_MMAP
+#    include "log_mmap.h"
 #  else
+#    include "evfs.h"
 #    include "log_evfs.h"
 #  endif
 #endif
@@ -138,6 +147,7 @@
 #  include "app_ui.h"
 #  include "disco_ui.hpp"
 #endif
+#include "app_prop_slots.h"
 
 
 #if defined PLATFORM_EMBEDDED
@@ -202,8 +212,11 @@ LogDB       g_log_db;
 ErrorLog    g_error_log;
 mpPoolSet   g_pool_set;
 UMsgTarget  g_tgt_event_buttons;
+PropPersist g_prop_persist;
 #if USE_LVGL
-UMsgTarget  g_tgt_gui_props;
+PropSnapshot g_prop_snapshot;
+UMsgBatchRouter g_msg_batch;  // Only the GUI uses batched delivery
+UMsgBatchTarget g_tgt_gui_props;
 #endif
 
 #if USE_AUDIO
@@ -265,7 +278,14 @@ static uint8_t s_log_db_data[LOG_NUM_SECTORS * LOG_SECTOR_SIZE];
 
 #else // Log to filesystem in hosted OS or flash memory
 #  if defined PLATFORM_HOSTED
+#    define LOG_FILE_PATH  "logdb.dat"
+#    if LOG_TO_MMAP
+static LogMmap s_log_mmap;
+#    else
   EvfsFile *s_log_db_file = NULL;
+static LogEvfs s_log_evfs;
+static bool s_log_evfs_ready = false;
+#    endif
 #  else // Embedded
 // Allocate flash storage in sectors 1, 2, and 3
 __attribute__(( section(".storage0") ))
@@ -274,10 +294,32 @@ static uint8_t s_log_db_data[LOG_NUM_SECTORS * LOG_SECTOR_SIZE];
 #endif
 
 
-#define ERROR_LOG_SECTOR_SIZE   (4 * sizeof(ErrorEntry))
-#define ERROR_LOG_NUM_SECTORS   2
+// The error log is a ring over its sectors and is only formatted when no valid
+// log is found at startup. Hosted builds with mmap persist it to a file.
+// Embedded boards with a STORAGE1 region keep it in flash sectors of its own
+// so it never shares an erase with the LogDB. On the F429 these are in bank 2
+// and erasing them doesn't stall code running from bank 1. The F401 has a
+// single sector so the log is cleared when it wraps, and that erase stalls
+// the CPU. Other builds keep the log in .noinit RAM which only survives warm
+// resets.
+#if !ERROR_LOG_TO_FLASH
+#  define ERROR_LOG_SECTOR_SIZE   (4 * sizeof(ErrorEntry))
+#  define ERROR_LOG_NUM_SECTORS   4
+#endif
+
+#if LOG_TO_MMAP
+#  define ERROR_LOG_FILE_PATH  "errlog.dat"
+static LogMmap s_error_log_mmap;
+#elif ERROR_LOG_TO_FLASH
+__attribute__(( section(".storage1") ))
+static uint8_t s_error_log_data[ERROR_LOG_NUM_SECTORS * ERROR_LOG_SECTOR_SIZE];
+#else
 alignas(ErrorEntry)
+#  ifdef PLATFORM_EMBEDDED
+__attribute__(( section(".noinit") ))
+#  endif
 static uint8_t s_error_log_data[ERROR_LOG_NUM_SECTORS * ERROR_LOG_SECTOR_SIZE];
+#endif
 
 static RTCDevice s_rtc_device;
 
@@ -308,41 +350,70 @@ DEF_PIN(g_usb_oc,         GPIO_PORT_C, 5,   GPIO_PIN_INPUT);
 #endif
 
 
+// Defaults are generated from PROP_SLOTS_APP in app_prop_slots.h
 static const PropDefaultDef s_prop_defaults[] = {
-  P_UINT(P_DEBUG_SYS_LOCAL_VALUE,     0, 0),  // Debug mode setting
-  P_UINT(P_APP_INFO_BUILD_VERSION,    APP_VERSION_INT, P_PROTECT | P_PERSIST),
-  P_UINT(P_SYS_STORAGE_INFO_COUNT,    0, P_PROTECT | P_PERSIST),  // Flash write counter
-  P_UINT((P1_APP | P2_INFO | P3_INFO | P4_VALUE), 0, P_PERSIST), // Dummy persistable value for testing
-#if USE_AUDIO // FIXME: Some are obsolete
-  P_UINT(P_APP_AUDIO_INFO_VALUE, 0, 0),
-  P_UINT(P_APP_AUDIO_INST0_FREQ,  440, 0),
-  P_UINT(P_APP_AUDIO_INST0_WAVE,   1, 0),
-  P_UINT(P_APP_AUDIO_INST0_CURVE,  0, 0),
-#endif
-#if USE_LVGL
-  P_UINT(P_APP_GUI_INFO__DARK,            0, P_PERSIST),
-  P_UINT(P_APP_GUI_UNITS__SPEED,         UNIT_MPH, P_PERSIST),
-  P_UINT(P_APP_GUI_UNITS__TEMPERATURE,   UNIT_CELSIUS, P_PERSIST),
-  P_UINT(P_APP_GUI_MENU__MODE,            0, 0),
-  P_UINT(P_SENSOR_ECU__SPEED__VALUE,      0, 0), // 24.8 fixed point km/h
-  P_UINT(P_SENSOR_ECU__SPEED__AVERAGE,    0, 0), // 24.8 fixed point km/h
-  P_UINT(P_SENSOR_ECU__SPEED__MAX,        0, 0), // 24.8 fixed point km/h
-  P_UINT(P_SENSOR_ECU__RPM__VALUE,        0, 0),
-  P_UINT(P_SENSOR_ECU__SIDESTAND__VALUE,  0, 0),  // Bool
-  P_UINT(P_SENSOR_ECU__GEAR__VALUE,       0, 0),  // 0 - 6
-  P_UINT(P_SENSOR_ECU__VOLTAGE__VALUE,      0, 0),  // 24.8 fixed point
-  P_INT(P_SENSOR_ECU__COOLANT_TEMP__VALUE,  0, 0),  // Celsius
-  P_UINT(P_SENSOR_ECU__FUEL__VALUE,         0, 0),  // 0 - 100 %
-#endif
+  PROP_SLOTS_APP(PROP_SLOT_DEFAULT_ITEM)
   P_END_DEFAULTS
 };
 
 
+#if USE_LVGL
+// GUI props are mirrored into a lock-free snapshot
+static const uint32_t s_prop_slot_ids[] = {
+  PROP_SLOTS_GUI(PROP_SLOT_ID_ITEM)
+};
+
+static PropSnapshotSlot s_prop_slots[PROP_SLOT_COUNT];
+#endif
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////
 
 
-void fatal_error(void) {
+#ifdef PLATFORM_HOSTED
+static struct timespec s_boot_timestamp;
+#endif
+
+// Time since reset for boot metrics only. Embedded builds wrap with the 32-bit
+// perf timer every 2^32 / perf_timer_freq() seconds and the converted value
+// jumps when it does. Hosted builds wrap after 71 minutes. Use elapsed_mark()
+// and elapsed_us() to time intervals.
+uint32_t boot_time_us(void) {
+#ifdef PLATFORM_EMBEDDED
+  // Perf timer starts at the beginning of platform_init()
+  return (uint32_t)((uint64_t)perf_timer_count() * 1000000ull / perf_timer_freq());
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)((now.tv_sec - s_boot_timestamp.tv_sec) * 1000000l +
+                    (now.tv_nsec - s_boot_timestamp.tv_nsec) / 1000l);
+#endif
+}
+
+
+// Start of an interval for elapsed_us(). Raw timer count on embedded.
+uint32_t elapsed_mark(void) {
 #ifdef PLATFORM_EMBEDDED
+  return perf_timer_count();
+#else
+  return boot_time_us();  // Modular us count
+#endif
+}
+
+
+// Time since mark. The counts are subtracted before conversion so the result
+// is correct across a timer wrap for intervals up to the wrap period.
+uint32_t elapsed_us(uint32_t mark) {
+#ifdef PLATFORM_EMBEDDED
+  return (uint32_t)((uint64_t)(perf_timer_count() - mark) * 1000000ull / perf_timer_freq());
+#else
+  return boot_time_us() - mark;
+#endif
+}
+
+
+#ifdef PLATFORM_EMBEDDED
+static void app__drain_console(void) {
 #  ifdef USE_CONSOLE
   Console *con = active_console();
   // Wait for Console TX queue to empty
@@ -351,6 +422,32 @@ void fatal_error(void) {
       delay_millis(200);
   }
 #  endif
+}
+#endif
+
+
+// Save pending prop changes unless the persist lock is busy. Faults in
+// interrupt context or in a nested fatal_error() skip it.
+static void app__fault_flush(void) {
+  static bool s_flushing = false;
+
+  if(s_flushing || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)
+    return;
+#ifdef PLATFORM_EMBEDDED
+  if(SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk)
+    return;
+#endif
+
+  s_flushing = true;
+  prop_persist_try_flush(&g_prop_persist, 0);
+}
+
+
+void fatal_error(void) {
+  app__fault_flush();
+
+#ifdef PLATFORM_EMBEDDED
+  app__drain_console();
 
   // Shutdown RTOS scheduler
   vTaskSuspendAll();
@@ -372,6 +469,28 @@ void fatal_error(void) {
 }
 
 
+// Orderly reset that saves pending prop changes first
+void app_restart(void) {
+  prop_persist_flush(&g_prop_persist);
+
+#ifdef PLATFORM_EMBEDDED
+  app__drain_console();
+  NVIC_SystemReset();
+#else
+  exit(0);
+#endif
+}
+
+
+#ifdef PLATFORM_HOSTED
+// Save pending prop changes when the simulator exits
+static void app__exit_flush(void) {
+  if(xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+    prop_persist_try_flush(&g_prop_persist, 0);
+}
+#endif
+
+
 #ifdef PLATFORM_EMBEDDED
 // STM32 HAL helper. Also used by FreeRTOS configASSERT() macro.
 void assert_failed(uint8_t *file, uint32_t line) {
@@ -477,19 +596,17 @@ static void filesystem_init(void) {
   unsigned no_dots = 1;
   evfs_vfs_ctrl(EVFS_CMD_SET_NO_DIR_DOTS, &no_dots);
 
-#  if !LOG_TO_RAM
-#    define LOG_FILE_PATH  "logdb.dat"
+#  if !LOG_TO_RAM && !LOG_TO_MMAP
   int fs_status = evfs_open(LOG_FILE_PATH, &s_log_db_file, EVFS_RDWR | EVFS_OPEN_OR_NEW);
   printf("EVFS opened log: %s\n", evfs_err_name(fs_status));
-  if(fs_status == EVFS_OK) {
-    if(evfs_file_size(s_log_db_file) == 0) { // New logdb file
-      // Grow file to required size
-      evfs_off_t last_byte = (LOG_NUM_SECTORS * LOG_SECTOR_SIZE) - 1;
-      evfs_file_seek(s_log_db_file, last_byte, EVFS_SEEK_TO);
-      uint8_t data = 0xAA;
-      evfs_file_write(s_log_db_file, &data, 1);
-    }
-  }
+  if(fs_status != EVFS_OK)
+    s_log_db_file = NULL;
+
+  // Grows a new or short logdb file to the full log size
+  s_log_evfs_ready = log_evfs_init(&s_log_evfs, s_log_db_file,
+                                   LOG_NUM_SECTORS * LOG_SECTOR_SIZE);
+  if(s_log_db_file && !s_log_evfs_ready)
+    puts("Failed to grow log file");
 #  endif
 }
 #endif // USE_FILESYSTEM
@@ -574,10 +691,9 @@ static void platform_init(void) {
   command_suite_add(&s_cmd_suite, g_app_cmd_set);
 #  ifdef PLATFORM_EMBEDDED
   command_suite_add(&s_cmd_suite, g_stm32_cmd_set);
-#  else // Hosted
-#    if USE_FILESYSTEM
+#  endif
+#  if USE_FILESYSTEM
   command_suite_add(&s_cmd_suite, g_filesystem_cmd_set);
-#    endif
 #  endif
 
   // Using console with malloc'ed buffers
@@ -624,6 +740,11 @@ static void platform_init(void) {
   filesystem_init();
 #endif
 
+#if LOG_TO_MMAP
+  if(!log_mmap_open(&s_log_mmap, LOG_FILE_PATH, LOG_NUM_SECTORS * LOG_SECTOR_SIZE))
+    printf("Failed to map log: %s\n", LOG_FILE_PATH);
+#endif
+
   // Mount log DB
   StorageConfig log_db_cfg = {
     .sector_size  = LOG_SECTOR_SIZE,
@@ -634,6 +755,11 @@ static void platform_init(void) {
     .erase_sector = log_ram_erase_sector,
     .read_block   = log_ram_read_block,
     .write_block  = log_ram_write_block
+#elif LOG_TO_MMAP // Log to memory mapped file
+    .ctx          = &s_log_mmap,
+    .erase_sector = log_mmap_erase_sector,
+    .read_block   = log_mmap_read_block,
+    .write_block  = log_mmap_write_block
 #else
 #  if !USE_FILESYSTEM // Log to flash
     .ctx          = s_log_db_data,
@@ -641,7 +767,7 @@ static void platform_init(void) {
     .read_block   = log_stm32_read_block,
     .write_block  = log_stm32_write_block
 #  else // Log to filesystem
-    .ctx          = s_log_db_file,
+    .ctx          = &s_log_evfs,
     .erase_sector = log_evfs_erase_sector,
     .read_block   = log_evfs_read_block,
     .write_block  = log_evfs_write_block
@@ -650,7 +776,16 @@ static void platform_init(void) {
   };
 
   logdb_init(&g_log_db, &log_db_cfg);
+#if !LOG_TO_RAM && !LOG_TO_MMAP && defined PLATFORM_HOSTED && USE_FILESYSTEM
+  if(s_log_evfs_ready) {
+    logdb_mount(&g_log_db);
+    log_evfs_sync(&s_log_evfs); // Commit any writes from formatting a new log
+  } else {
+    printf("LogDB not mounted: %s unavailable\n", LOG_FILE_PATH);
+  }
+#else
   logdb_mount(&g_log_db);
+#endif
 
 #if defined PLATFORM_EMBEDDED && !defined NDEBUG
   const char *location = LOG_TO_RAM ? "RAM" : USE_FILESYSTEM ? "Filesystem" : "Flash";
@@ -660,19 +795,40 @@ static void platform_init(void) {
 
 
   // Mount error log
+#if LOG_TO_MMAP
+  if(!log_mmap_open(&s_error_log_mmap, ERROR_LOG_FILE_PATH,
+                    ERROR_LOG_NUM_SECTORS * ERROR_LOG_SECTOR_SIZE))
+    printf("Failed to map error log: %s\n", ERROR_LOG_FILE_PATH);
+#endif
+
   StorageConfig error_log_cfg = {
     .sector_size  = ERROR_LOG_SECTOR_SIZE,
     .num_sectors  = ERROR_LOG_NUM_SECTORS,
-    .ctx          = s_error_log_data,
 
+#if LOG_TO_MMAP
+    .ctx          = &s_error_log_mmap,
+    .erase_sector = log_mmap_erase_sector,
+    .read_block   = log_mmap_read_block,
+    .write_block  = log_mmap_write_block
+#elif ERROR_LOG_TO_FLASH
+    .ctx          = s_error_log_data,
+    .erase_sector = log_stm32_erase_sector,
+    .read_block   = log_stm32_read_block,
+    .write_block  = log_stm32_write_block
+#else
+    .ctx          = s_error_log_data,
     .erase_sector = log_ram_erase_sector,
     .read_block   = log_ram_read_block,
     .write_block  = log_ram_write_block
+#endif
   };
 
   errlog_init(&g_error_log, &error_log_cfg);
-  errlog_format(&g_error_log);
-  errlog_mount(&g_error_log);
+  // Keep errors from before the last reset
+  if(!errlog_mount(&g_error_log)) {
+    errlog_format(&g_error_log);
+    errlog_mount(&g_error_log);
+  }
 
 
   // Configure RTC
@@ -813,6 +969,7 @@ DEF_PIN(g_i2s_gain,     GPIO_PORT_E, 1,  GPIO_PIN_OUTPUT_H);  // 3dB default
 
 
 
+// Key events must not be dropped or delayed so this stays a direct hub callback
 static void audio_ctl_handler(UMsgTarget *tgt, UMsg *msg) {
   // Avoid message loops for props set by console commands
 //  if(msg->source == P_RSRC_CON_LOCAL_TASK);
@@ -878,6 +1035,7 @@ static void audio_ctl_handler(UMsgTarget *tgt, UMsg *msg) {
     break;
   }
 }
+
 #endif // USE_AUDIO
 
 
@@ -993,9 +1151,13 @@ static void portable_init(void) {
   prop_set_attributes(&g_prop_db, P_SYS_PRNG_LOCAL_VALUE, P_PROTECT | P_PERSIST);
 
 
-  // Load properties from log DB
+  // Load properties from log DB. This replays the whole log. The restore time
+  // is kept as a prop to track the cost as the log grows.
+  uint32_t restore_start = elapsed_mark();
   unsigned count = restore_props_from_log(&g_prop_db, &g_log_db);
-  printf("Retrieved %u properties from log\n", count);
+  uint32_t restore_time = elapsed_us(restore_start);
+  printf("Retrieved %u properties from log in %" PRIu32 " us\n", count, restore_time);
+  prop_set_uint(&g_prop_db, P_APP_BOOT_INFO_RESTORE, restore_time, 0);
 
 
   // Init message hub
@@ -1006,6 +1168,12 @@ static void portable_init(void) {
   umsg_tgt_add_filter(&g_tgt_event_buttons, P1_EVENT| P2_BUTTON | P3_MSK | P4_MSK);
   umsg_hub_subscribe(&g_msg_hub, &g_tgt_event_buttons);
 
+#if USE_LVGL
+  // Snapshot must be subscribed before any consumers so it is current
+  prop_snapshot_init(&g_prop_snapshot, s_prop_slot_ids, s_prop_slots, PROP_SLOT_COUNT,
+                     prop_slot, &g_prop_db, &g_msg_hub);
+#endif
+
 #if USE_AUDIO
   umsg_tgt_callback_init(&g_tgt_audio_ctl, audio_ctl_handler);
   umsg_tgt_add_filter(&g_tgt_audio_ctl, (P1_APP | P2_AUDIO | P3_MSK | P4_MSK));
@@ -1016,11 +1184,11 @@ static void portable_init(void) {
 #endif
 
 #if USE_LVGL
-  // Capture GUI property changes
-  umsg_tgt_callback_init(&g_tgt_gui_props, gui_prop_msg_handler);
-  umsg_tgt_add_filter(&g_tgt_gui_props, (P1_APP | P2_GUI | P3_MSK | P4_MSK));
-  umsg_tgt_add_filter(&g_tgt_gui_props, P_SENSOR_ECU_n_MSK);
-  umsg_hub_subscribe(&g_msg_hub, &g_tgt_gui_props);
+  // GUI props are dispatched in batches from an indexed filter table. The
+  // router and its task are only created when there is a batch target.
+  umsg_batch_init(&g_msg_batch, &g_msg_hub);
+  gui_prop_batch_init(&g_msg_batch, &g_tgt_gui_props);
+  umsg_batch_start(&g_msg_batch, TASK_PRIO_LOW);
 #endif
 
   // Any DB event messages sent before now were discarded because there wasn't a hub
@@ -1028,6 +1196,20 @@ static void portable_init(void) {
   prop_db_set_msg_hub(&g_prop_db, (UMsgTarget *)&g_msg_hub);
   g_prop_db.persist_updated = false; // Clear flag set by any init code
 
+  // Coalesce persistent prop writes to LogDB
+  prop_persist_init(&g_prop_persist, &g_prop_db, &g_log_db, PERSIST_COALESCE_MS,
+                    PERSIST_MAX_DELAY_MS);
+  // Commit buffered log writes after each flush
+#if LOG_TO_MMAP
+  prop_persist_set_sync(&g_prop_persist, log_mmap_sync, &s_log_mmap);
+#elif !LOG_TO_RAM && defined PLATFORM_HOSTED && USE_FILESYSTEM
+  prop_persist_set_sync(&g_prop_persist, log_evfs_sync, &s_log_evfs);
+#endif
+  prop_persist_start(&g_prop_persist, PERSIST_POLL_MS);
+#ifdef PLATFORM_HOSTED
+  atexit(app__exit_flush);
+#endif
+
 
 #ifdef USE_CONSOLE
   // Generate first prompt after all boot messages
@@ -1049,6 +1231,8 @@ static void end_sequence(Sequence *seq) {
 int main(void) {
 #ifdef PLATFORM_EMBEDDED
   sys_stack_fill();
+#else
+  clock_gettime(CLOCK_MONOTONIC, &s_boot_timestamp);
 #endif
   platform_init();
   portable_init();
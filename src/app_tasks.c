@@ -42,10 +42,23 @@
 #if USE_AUDIO
 #  include "sample_device.h"
 #  include "audio_synth.h"
+#  include "audio_tap.h"
+#  if USE_FILESYSTEM
+#    include "synth_stream.h"
+#  endif
 #endif
 
 #if USE_LVGL
 #  include "lvgl/lvgl.h"
+#  include "lib_cfg/lv_tick_src.h"
+#  include "cstone/prop_db.h"
+#  include "ui_panel.h"
+#  include "ui_units.h"
+#  include "app_ui.h"
+#  if USE_GUI_PROFILE
+#    include "gui_profile.h"
+#  endif
+#  include "disco_ui.hpp"
 #endif
 
 
@@ -85,17 +98,68 @@ static void debounce_task_cb(TimerHandle_t timer) {
 
 // TASK: LVGL
 #if USE_LVGL
-static void lvgl_task_cb(void *ctx) {
-  lv_timer_handler();
+/*
+The LVGL task sleeps until the next LVGL timer is due. lv_timer_handler()
+returns that delay. LVGL pauses its refresh timer until something is
+invalidated and, on embedded, idle input devices pause their read timers.
+A static screen therefore only wakes the task for animations or the
+LVGL_TASK_MAX_MS limit.
+
+New props and input events wake the task early with gui_task_wake(). The wake
+is also recorded in a flag because lcd_flush_wait() takes notifications on
+this task and could consume it. Loops are at least LVGL_TASK_MS apart so
+coalesced sensor props are still rendered in batches.
+*/
+static TaskHandle_t s_lvgl_task = NULL;
+static volatile bool s_lvgl_wake = false;
+
+// LVGL time base. Selected with LV_TICK_CUSTOM in lv_conf.h.
+uint32_t gui_tick_ms(void) {
+  return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+
+// Run the LVGL task early. Safe to call from any task.
+void gui_task_wake(void) {
+  s_lvgl_wake = true;
+
+  TaskHandle_t task = s_lvgl_task;
+  if(task)
+    xTaskNotifyGive(task);
 }
 
-#  ifdef PLATFORM_HOSTED
-#    define LVGL_TICK_TASK_MS  5
-// TIMER TASK: LVGL sys tick
-void lvgl_tick_task(TimerHandle_t timer) {
-  lv_tick_inc(LVGL_TICK_TASK_MS);
+
+static void lvgl_task(void *ctx) {
+  TickType_t loop_start = xTaskGetTickCount();
+
+  while(1) {
+    // Limit loop rate when woken repeatedly
+    TickType_t elapsed = xTaskGetTickCount() - loop_start;
+    if(elapsed < pdMS_TO_TICKS(LVGL_TASK_MS))
+      vTaskDelay(pdMS_TO_TICKS(LVGL_TASK_MS) - elapsed);
+    loop_start = xTaskGetTickCount();
+
+    s_lvgl_wake = false;
+    gui_input_resume();
+
+    // Render coalesced sensor updates at the frame rate
+    gui_prop_drain();
+
+#  if USE_GUI_PROFILE
+    uint32_t start = elapsed_mark();
+    uint32_t sleep_ms = lv_timer_handler();
+    gui_profile_render(start);
+#  else
+    uint32_t sleep_ms = lv_timer_handler();
+#  endif
+
+    if(sleep_ms > LVGL_TASK_MAX_MS) // Includes LV_NO_TIMER_READY
+      sleep_ms = LVGL_TASK_MAX_MS;
+
+    if(!s_lvgl_wake)
+      ulTaskNotifyTake(/*xClearCountOnExit*/ pdTRUE, pdMS_TO_TICKS(sleep_ms));
+  }
 }
-#  endif // PLATFORM_HOSTED
 #endif // USE_LVGL
 
 
@@ -125,27 +189,7 @@ void app_tasks_init(void) {
 
 #if USE_LVGL
 void gui_tasks_init(void) {
-
-  static PeriodicTaskCfg lvgl_task_cfg = { // LVGL updates
-    .task   = lvgl_task_cb,
-    .ctx    = NULL,
-    .period = LVGL_TASK_MS,
-    .repeat = REPEAT_FOREVER
-  };
-
-  create_periodic_task("LVGL", STACK_BYTES(4096), TASK_PRIO_LOW, &lvgl_task_cfg);
-
-#  ifdef PLATFORM_HOSTED
-  TimerHandle_t lvgl_tick_timer = xTimerCreate(  // LVGL system tick
-    "LVGLtick",
-    LVGL_TICK_TASK_MS,
-    pdTRUE, // uxAutoReload
-    NULL,   // pvTimerID
-    lvgl_tick_task
-  );
-
-  xTimerStart(lvgl_tick_timer, 0);
-#  endif
+  xTaskCreate(lvgl_task, "LVGL", STACK_BYTES(4096), NULL, TASK_PRIO_LOW, &s_lvgl_task);
 }
 #endif // USE_LVGL
 
@@ -171,6 +215,12 @@ static void audio_synth_task(void *ctx) {
 void audio_tasks_init(void) {
   xTaskCreate(audio_synth_task, "synth", STACK_BYTES(1024*2),
               NULL, TASK_PRIO_HIGH, &g_audio_synth_task);
+
+  audio_tap_task_init();
+
+#  if USE_FILESYSTEM
+  synth_stream_task_init(&g_audio_synth);
+#  endif
 }
 
 #endif // USE_AUDIO
@@ -2,10 +2,13 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "lib_cfg/build_config.h"
 #include "lib_cfg/cstone_cfg_stm32.h"
 #include "app_main.h"
+#include "app_tasks.h"
 
 #include "cstone/prop_id.h"
 #include "app_prop_id.h"
@@ -13,14 +16,27 @@
 #include "util/mempool.h"
 #include "cstone/umsg.h"
 #include "cstone/debug.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "umsg_batch.h"
+#include "prop_snapshot.h"
 
 //#include "util/dhash.h"
 #include "lvgl/lvgl.h"
 #include "ui_panel.h"
 #include "ui_units.h"
 #include "app_ui.h"
+#include "app_prop_slots.h"
+#if USE_GUI_PROFILE
+#  include "gui_profile.h"
+#endif
+#if USE_TACH_SPRITES
+#  include "tach_sprite.h"
+#endif
 #include "util/range_strings.h"
 #include "util/intmath.h"
+#include "util/getopt_r.h"
 
 
 #define TILEVIEW_COLOR          lv_palette_lighten(LV_PALETTE_GREY, 3)
@@ -31,6 +47,9 @@
 #define TACHO_IND_COLOR         lv_palette_main(LV_PALETTE_BLUE)
 #define TACHO_BAR_W             12
 
+#define TACHO_SWEEP_RPM         10000
+#define TACHO_SWEEP_MS          2000
+
 #define GEAR_POS_BG_COLOR       lv_palette_darken(LV_PALETTE_BLUE_GREY, 2)
 
 #define UTF8_DEGREE "\xc2\xb0"
@@ -42,6 +61,7 @@ lv_disp_t *g_disp_main;
 AppPanels g_panels = {0};
 UIStyles g_ui_styles;
 
+extern PropSnapshot g_prop_snapshot;
 extern UIReactWidgets g_react_widgets;
 extern UIWidgetRegistry  g_widget_reg;
 
@@ -66,34 +86,60 @@ extern bool ts_set_calibration(TouchCalPoint *p0, TouchCalPoint *p1);
 
 // ******************** App props ********************
 
+static void gui__request_theme(bool dark_mode);
+static void gui__apply_theme(void);
+
+// Read from the prop snapshot when possible to avoid the prop DB hash.
+// Known prop IDs resolve to a constant slot index at compile time.
+static inline bool gui__prop_get(uint32_t prop, PropDBEntry *value) {
+  int slot = prop_slot(prop);
+  if(slot >= 0) {
+    value->value = prop_snapshot_read_slot(&g_prop_snapshot, slot);
+    return true;
+  }
+
+  return prop_get(&g_prop_db, prop, value);
+}
+
 
 static int32_t convert_si_value(int32_t si_value, int32_t fp_scale, uint32_t prop) {
   PropDBEntry value;
-  prop_get(&g_prop_db, prop, &value); // Get units enum for si_value
+  gui__prop_get(prop, &value); // Get units enum for si_value
 
   return convert_to_unit(si_value, fp_scale, (UIUnits)value.value);
 }
 
 
+// Round a 24.8 fixed point value to an integer count of 10^-decimals units.
+// Labels are cached and formatted from this so unchanged text is never rebuilt.
+static inline uint32_t gui__quantize_ufixed(uint32_t fp_value, unsigned decimals) {
+  uint32_t scale = 1;
+  while(decimals-- > 0) {
+    scale *= 10;
+  }
+
+  return ((uint64_t)fp_value * scale + FIXED_24_8/2) / FIXED_24_8;
+}
+
+
 static void update_speed_value(uint32_t prop) {
   PropDBEntry value;
 
-  if(prop_get(&g_prop_db, prop, &value)) {
+  if(gui__prop_get(prop, &value)) {
     lv_obj_t *obj = ui_panel_get_obj(&g_panels.instr, W_INSTR_LBL_SPEED);
     if(obj) {
       int32_t unit_val = convert_si_value(value.value, FIXED_24_8, P_APP_GUI_UNITS__SPEED);
       // Format 24.8 fixed point value
       unit_val = ufixed_to_uint(unit_val, FIXED_24_8); // Round up
-      lv_label_set_text_fmt(obj, "%3" PRIu32, unit_val); // Right justify 3 digits
+      if(ui_panel_value_changed(&g_panels.instr, W_INSTR_LBL_SPEED, unit_val))
+        lv_label_set_text_fmt(obj, "%3" PRIu32, unit_val); // Right justify 3 digits
     }
 
     // Update max speed
     uint32_t cur_speed = value.value;
-    prop_get(&g_prop_db, P_SENSOR_ECU__SPEED__MAX, &value);
-    if(cur_speed > value.value) {
-      value.value = cur_speed;
-      prop_set(&g_prop_db, P_SENSOR_ECU__SPEED__MAX, &value, 0);
-    }
+    gui__prop_get(P_SENSOR_ECU__SPEED__MAX, &value);
+    if(cur_speed > value.value)
+      prop_set_uint(&g_prop_db, P_SENSOR_ECU__SPEED__MAX, cur_speed, 0);
 
   }
 }
@@ -101,17 +147,14 @@ static void update_speed_value(uint32_t prop) {
 
 static void update_voltage_value(uint32_t prop) {
   PropDBEntry value;
-  char buf[8]; // "nn.n V"
-  AppendRange rng;
 
-  if(prop_get(&g_prop_db, prop, &value)) {
+  if(gui__prop_get(prop, &value)) {
     lv_obj_t *obj = ui_panel_get_obj(&g_panels.instr, W_INSTR_LBL_VOLTAGE);
     if(obj) {
-      // Format 24.8 fixed point value
-      range_init(&rng, buf, sizeof(buf));
-      range_cat_ufixed(&rng, value.value, FIXED_24_8, 1);
-      range_cat_str(&rng, " V");
-      lv_label_set_text(obj, buf);
+      // Format 24.8 fixed point value as "nn.n V"
+      uint32_t tenths = gui__quantize_ufixed(value.value, 1);
+      if(ui_panel_value_changed(&g_panels.instr, W_INSTR_LBL_VOLTAGE, tenths))
+        lv_label_set_text_fmt(obj, "%" PRIu32 ".%" PRIu32 " V", tenths / 10, tenths % 10);
     }
   }
 }
@@ -119,11 +162,13 @@ static void update_voltage_value(uint32_t prop) {
 static void update_coolant_temp_value(uint32_t prop) {
   PropDBEntry value;
 
-  if(prop_get(&g_prop_db, prop, &value)) {
+  if(gui__prop_get(prop, &value)) {
     lv_obj_t *obj = ui_panel_get_obj(&g_panels.instr, W_INSTR_LBL_COOLANT_TEMP);
     if(obj) {
       int32_t unit_val = convert_si_value(value.value, 1, P_APP_GUI_UNITS__TEMPERATURE);
-      prop_get(&g_prop_db, P_APP_GUI_UNITS__TEMPERATURE, &value); // Get units enum
+      if(!ui_panel_value_changed(&g_panels.instr, W_INSTR_LBL_COOLANT_TEMP, unit_val))
+        return;
+      gui__prop_get(P_APP_GUI_UNITS__TEMPERATURE, &value); // Get units enum
       lv_label_set_text_fmt(obj, "%3" PRIu32 " " UTF8_DEGREE "%s", unit_val, get_unit_text(value.value));
     }
   }
@@ -133,12 +178,13 @@ static void update_coolant_temp_value(uint32_t prop) {
 static void update_fuel_value(uint32_t prop) {
   PropDBEntry value;
 
-  if(prop_get(&g_prop_db, prop, &value)) {
+  if(gui__prop_get(prop, &value)) {
     lv_obj_t *obj = ui_panel_get_obj(&g_panels.instr, W_INSTR_LBL_FUEL);
     if(obj) {
       if(value.value > 100)
         value.value = 100;
-      lv_label_set_text_fmt(obj, "%3" PRIu32 " %%", (uint32_t)value.value);
+      if(ui_panel_value_changed(&g_panels.instr, W_INSTR_LBL_FUEL, value.value))
+        lv_label_set_text_fmt(obj, "%3" PRIu32 " %%", (uint32_t)value.value);
     }
   }
 }
@@ -146,44 +192,39 @@ static void update_fuel_value(uint32_t prop) {
 
 static void update_speed_average(uint32_t prop) {
   PropDBEntry value;
-  char buf[14]; // "nnn.nn km/h"
-  AppendRange rng;
 
-  if(prop_get(&g_prop_db, prop, &value)) {
+  if(gui__prop_get(prop, &value)) {
     lv_obj_t *obj = ui_panel_get_obj(&g_panels.instr, W_INSTR_LBL_SPEED_AVG);
     if(obj) {
       uint32_t unit_val = convert_si_value(value.value, FIXED_24_8, P_APP_GUI_UNITS__SPEED);
 //      printf("## SPEED AVG: %u  %lu\n", value.value, unit_val);
 
-      // Format 24.8 fixed point value with units
-      range_init(&rng, buf, sizeof(buf));
-      range_cat_ufixed(&rng, unit_val, FIXED_24_8, 1);
-      range_cat_char(&rng, ' ');
-      prop_get(&g_prop_db, P_APP_GUI_UNITS__SPEED, &value); // Get units enum
-      range_cat_str(&rng, get_unit_text(value.value));
-      lv_label_set_text(obj, buf);
+      // Format 24.8 fixed point value with units as "nnn.n km/h"
+      uint32_t tenths = gui__quantize_ufixed(unit_val, 1);
+      if(!ui_panel_value_changed(&g_panels.instr, W_INSTR_LBL_SPEED_AVG, tenths))
+        return;
+      gui__prop_get(P_APP_GUI_UNITS__SPEED, &value); // Get units enum
+      lv_label_set_text_fmt(obj, "%" PRIu32 ".%" PRIu32 " %s", tenths / 10, tenths % 10,
+                            get_unit_text(value.value));
     }
   }
 }
 
 static void update_speed_max(uint32_t prop) {
   PropDBEntry value;
-  char buf[14]; // "nnn.nn km/h"
-  AppendRange rng;
 
-  if(prop_get(&g_prop_db, prop, &value)) {
+  if(gui__prop_get(prop, &value)) {
     lv_obj_t *obj = ui_panel_get_obj(&g_panels.instr, W_INSTR_LBL_SPEED_MAX);
     if(obj) {
       uint32_t unit_val = convert_si_value(value.value, FIXED_24_8, P_APP_GUI_UNITS__SPEED);
 //      printf("## SPEED MAX: %u  %lu\n", value.value, unit_val);
 
-      // Format 24.8 fixed point value with units
-      range_init(&rng, buf, sizeof(buf));
-      range_cat_ufixed(&rng, unit_val, FIXED_24_8, 0);
-      range_cat_char(&rng, ' ');
-      prop_get(&g_prop_db, P_APP_GUI_UNITS__SPEED, &value); // Get units enum
-      range_cat_str(&rng, get_unit_text(value.value));
-      lv_label_set_text(obj, buf);
+      // Format 24.8 fixed point value with units as "nnn km/h"
+      uint32_t whole = gui__quantize_ufixed(unit_val, 0);
+      if(!ui_panel_value_changed(&g_panels.instr, W_INSTR_LBL_SPEED_MAX, whole))
+        return;
+      gui__prop_get(P_APP_GUI_UNITS__SPEED, &value); // Get units enum
+      lv_label_set_text_fmt(obj, "%" PRIu32 " %s", whole, get_unit_text(value.value));
     }
   }
 }
@@ -194,12 +235,16 @@ void gui_prop_msg_handler(UMsgTarget *tgt, UMsg *msg) {
   if(msg->source == P_RSRC_GUI_LOCAL_WIDGET)
     return;
 
+#if USE_GUI_PROFILE
+  uint32_t start = elapsed_mark();
+#endif
+
   PropDBEntry value;
   switch(msg->id) {
   case P_APP_GUI_INFO__DARK:
-    // Change LVGL dark mode setting
-    if(prop_get(&g_prop_db, msg->id, &value))
-      set_theme_mode(g_disp_main, value.value);
+    // Change LVGL dark mode setting in the LVGL task
+    if(gui__prop_get(msg->id, &value))
+      gui__request_theme(value.value);
     break;
 
   case P_SENSOR_ECU__SPEED__VALUE:
@@ -208,6 +253,9 @@ void gui_prop_msg_handler(UMsgTarget *tgt, UMsg *msg) {
 
   case P_APP_GUI_UNITS__SPEED:
     {
+      // Label text changes even if the converted values don't
+      ui_panel_value_reset(&g_panels.instr, W_INSTR_LBL_SPEED_AVG);
+      ui_panel_value_reset(&g_panels.instr, W_INSTR_LBL_SPEED_MAX);
       update_speed_value(P_SENSOR_ECU__SPEED__VALUE);
       update_speed_average(P_SENSOR_ECU__SPEED__AVERAGE);
       update_speed_max(P_SENSOR_ECU__SPEED__MAX);
@@ -220,6 +268,8 @@ void gui_prop_msg_handler(UMsgTarget *tgt, UMsg *msg) {
     break;
 
   case P_APP_GUI_UNITS__TEMPERATURE:
+    // Label text changes even if the converted value doesn't
+    ui_panel_value_reset(&g_panels.instr, W_INSTR_LBL_COOLANT_TEMP);
     update_coolant_temp_value(P_SENSOR_ECU__COOLANT_TEMP__VALUE);
     break;
 
@@ -245,22 +295,22 @@ void gui_prop_msg_handler(UMsgTarget *tgt, UMsg *msg) {
 
 
   case P_APP_GUI_MENU__MODE:
-    if(prop_get(&g_prop_db, msg->id, &value))
+    if(gui__prop_get(msg->id, &value))
       update_gui_menu_mode(value.value);
     break;
 
   case P_SENSOR_ECU__RPM__VALUE:
-    if(prop_get(&g_prop_db, msg->id, &value))
+    if(gui__prop_get(msg->id, &value))
       update_tacho(value.value);
     break;
 
   case P_SENSOR_ECU__SIDESTAND__VALUE:
-    if(prop_get(&g_prop_db, msg->id, &value))
+    if(gui__prop_get(msg->id, &value))
       update_sidestand(value.value);
     break;
 
   case P_SENSOR_ECU__GEAR__VALUE:
-    if(prop_get(&g_prop_db, msg->id, &value))
+    if(gui__prop_get(msg->id, &value))
       update_gear_pos(value.value);
     break;
 
@@ -268,10 +318,199 @@ void gui_prop_msg_handler(UMsgTarget *tgt, UMsg *msg) {
     break;
   }
 
-  ui_react_widgets_update(&g_react_widgets, &g_widget_reg, msg->id);
+  ui_react_widgets_update(&g_react_widgets, msg->id);
+
+#if USE_GUI_PROFILE
+  gui_profile_handler(msg->id, start);
+#endif
 }
 
 
+// High rate sensor props are coalesced and only the latest value is rendered
+// once per frame by gui_prop_drain()
+static const uint32_t s_coalesced_gui_props[] = {
+  P_SENSOR_ECU__SPEED__VALUE,
+  P_SENSOR_ECU__SPEED__AVERAGE,
+  P_SENSOR_ECU__SPEED__MAX,
+  P_SENSOR_ECU__RPM__VALUE,
+  P_SENSOR_ECU__SIDESTAND__VALUE,
+  P_SENSOR_ECU__GEAR__VALUE,
+  P_SENSOR_ECU__VOLTAGE__VALUE,
+  P_SENSOR_ECU__COOLANT_TEMP__VALUE,
+  P_SENSOR_ECU__FUEL__VALUE
+};
+
+static UMsg s_coalesced_gui_msgs[COUNT_OF(s_coalesced_gui_props)];
+static UMsgCoalesce s_gui_coalesce;
+
+
+// Other GUI props are queued in order for the LVGL task. The batch task blocks
+// when the queue is full rather than dropping a prop change.
+#define GUI_PROP_QUEUE_SIZE   16
+static QueueHandle_t s_gui_prop_queue = NULL;
+
+
+// Props with a handler in gui_prop_msg_handler() are kept as last-value-wins by
+// the batch router. A burst of sensor traffic or react widget props can then
+// fill its queue without losing a settings or sensor change.
+static const uint32_t s_batch_gui_props[] = {
+  P_SENSOR_ECU__SPEED__VALUE,
+  P_SENSOR_ECU__SPEED__AVERAGE,
+  P_SENSOR_ECU__SPEED__MAX,
+  P_SENSOR_ECU__RPM__VALUE,
+  P_SENSOR_ECU__SIDESTAND__VALUE,
+  P_SENSOR_ECU__GEAR__VALUE,
+  P_SENSOR_ECU__VOLTAGE__VALUE,
+  P_SENSOR_ECU__COOLANT_TEMP__VALUE,
+  P_SENSOR_ECU__FUEL__VALUE,
+  P_APP_GUI_INFO__DARK,
+  P_APP_GUI_UNITS__SPEED,
+  P_APP_GUI_UNITS__TEMPERATURE,
+  P_APP_GUI_MENU__MODE
+};
+
+static UMsg s_batch_gui_msgs[COUNT_OF(s_batch_gui_props)];
+static UMsgCoalesce s_batch_gui_coalesce;
+
+
+// Subscribe GUI props through the batch router
+void gui_prop_batch_init(struct UMsgBatchRouter *router, struct UMsgBatchTarget *btgt) {
+  umsg_coalesce_init(&s_batch_gui_coalesce, s_batch_gui_props, s_batch_gui_msgs,
+                     COUNT_OF(s_batch_gui_props));
+
+  umsg_batch_add_target(router, btgt, gui_prop_batch_handler, NULL);
+  umsg_batch_set_coalesce(btgt, &s_batch_gui_coalesce);
+  umsg_batch_add_filter(router, btgt, (P1_APP | P2_GUI | P3_MSK | P4_MSK));
+  umsg_batch_add_filter(router, btgt, P_SENSOR_ECU_n_MSK);
+}
+
+
+// Runs in the batch delivery task. LVGL is only touched by gui_prop_drain().
+void gui_prop_batch_handler(struct UMsgBatchTarget *btgt, UMsg *msgs, unsigned msg_count) {
+  for(unsigned i = 0; i < msg_count; i++) {
+    // Avoid message loops for props set by LVGL widget updates
+    if(msgs[i].source == P_RSRC_GUI_LOCAL_WIDGET)
+      continue;
+
+    if(umsg_coalesce_put(&s_gui_coalesce, &msgs[i]))
+      continue;
+
+    // Handlers read the current value from the prop DB so only the last message
+    // for a prop in the batch needs to be processed.
+    bool superseded = false;
+    for(unsigned j = i+1; j < msg_count; j++) {
+      if(msgs[j].id == msgs[i].id && msgs[j].source == msgs[i].source) {
+        superseded = true;
+        break;
+      }
+    }
+
+    if(superseded)
+      continue;
+
+    if(xQueueSend(s_gui_prop_queue, &msgs[i], 0) != pdTRUE) {
+      gui_task_wake(); // Make room
+      xQueueSend(s_gui_prop_queue, &msgs[i], portMAX_DELAY);
+    }
+  }
+
+  // Render the changes without waiting for the next LVGL timer
+  gui_task_wake();
+}
+
+
+#if USE_GUI_PROFILE
+static volatile bool s_tacho_sweep = false;
+static void gui__tacho_sweep_start(void);
+#endif
+
+// Called from the LVGL task before rendering each frame
+unsigned gui_prop_drain(void) {
+#if USE_GUI_PROFILE
+  if(s_tacho_sweep) { // Benchmark requested from console
+    s_tacho_sweep = false;
+    gui__tacho_sweep_start();
+  }
+#endif
+
+  gui__apply_theme();
+
+  unsigned count = 0;
+  UMsg msg;
+  while(xQueueReceive(s_gui_prop_queue, &msg, 0) == pdTRUE) {
+    gui_prop_msg_handler(NULL, &msg);
+    count++;
+  }
+
+  return count + umsg_coalesce_drain(&s_gui_coalesce, gui_prop_msg_handler);
+}
+
+
+// LVGL display monitor callback invoked after each refresh
+void gui_refr_monitor(lv_disp_drv_t *disp_drv, uint32_t time, uint32_t px) {
+  static bool first_frame = true;
+
+  if(first_frame) { // Record time to first frame
+    first_frame = false;
+    prop_set_uint(&g_prop_db, P_APP_BOOT_INFO_FRAME, boot_time_us() / 1000, P_RSRC_GUI_LOCAL_WIDGET);
+  }
+
+#if USE_GUI_PROFILE
+  gui_profile_refr(time);
+#endif
+}
+
+
+#if USE_GUI_PROFILE
+int32_t cmd_frame(uint8_t argc, char *argv[], void *eval_ctx) {
+  GetoptState state = {0};
+  state.report_errors = true;
+  int c;
+
+  while((c = getopt_r(argv, "rtoh", &state)) != -1) {
+    switch(c) {
+    case 'r':
+      gui_profile_reset();
+      return 0;
+      break;
+
+    case 'o':
+      gui_profile_show_overlay(!gui_profile_overlay_shown());
+      return 0;
+      break;
+
+    case 't':
+      s_tacho_sweep = true;
+      gui_task_wake();
+      printf("Tacho sweep for %d ms\n", TACHO_SWEEP_MS*2);
+      return 0;
+      break;
+
+    case 'h':
+      puts("frame [-r] [-t] [-o] [-h]");
+      puts("  Show GUI refresh times and profile. -r resets the stats.");
+      puts("  -t resets the stats and sweeps the tacho as a benchmark.");
+      puts("  -o toggles the profiler overlay.");
+      return 0;
+      break;
+
+    default:
+    case ':':
+    case '?':
+      return -3;
+      break;
+    }
+  }
+
+  printf("Color depth: %d-bit\n", LCD_COLOR_DEPTH);
+  printf("Tacho:   %s\n", gui_tacho_sprites_active() ? "sprites" : "widgets");
+  gui_profile_report();
+
+  return 0;
+}
+#endif // USE_GUI_PROFILE
+
+
 // Properties that need to be checked on startup to ensure initial state of
 // GUI is correct before first frame is rendered.
 static const uint32_t s_default_gui_props[] = {
@@ -283,18 +522,58 @@ static const uint32_t s_default_gui_props[] = {
 void gui_prop_init(void) {
   UMsg msg = {0};
 
+  umsg_coalesce_init(&s_gui_coalesce, s_coalesced_gui_props, s_coalesced_gui_msgs,
+                     COUNT_OF(s_coalesced_gui_props));
+  s_gui_prop_queue = xQueueCreate(GUI_PROP_QUEUE_SIZE, sizeof(UMsg));
+
   // Send messages directly to the handler since the msg hub isn't usable
   // before the scheduler is active.
   for(unsigned i = 0; i < COUNT_OF(s_default_gui_props); i++) {
     msg.id = s_default_gui_props[i];
     gui_prop_msg_handler(NULL, &msg);
   }
+
+  // Apply initial theme now so the first frame isn't drawn with the default
+  gui__apply_theme();
 }
 
 
 // ******************** App styling ********************
 
+/*
+Theme changes restyle every widget in one pass since the default theme calls
+lv_obj_report_style_change() on the whole tree. Doing that from the message hub
+stalls delivery of other messages and races the LVGL task. Requests are instead
+recorded and applied by the LVGL task between frames. Repeated toggles before
+the next frame collapse into one change, and a request for the current mode is
+dropped.
+*/
+#define THEME_NONE  (-1)
+
+static volatile int8_t s_theme_request = THEME_NONE;
+static int8_t s_theme_dark = THEME_NONE;  // Mode last applied
+
+
+// Safe to call from any task. Returns immediately.
+static void gui__request_theme(bool dark_mode) {
+  s_theme_request = dark_mode;
+}
+
+
+// Called from the LVGL task
+static void gui__apply_theme(void) {
+  int8_t dark_mode = __atomic_exchange_n(&s_theme_request, THEME_NONE, __ATOMIC_ACQ_REL);
+  if(dark_mode == THEME_NONE)
+    return;
+
+  if(dark_mode != s_theme_dark)
+    set_theme_mode(g_disp_main, dark_mode);
+}
+
+
 lv_theme_t *set_theme_mode(lv_disp_t *disp, bool dark_mode) {
+  s_theme_dark = dark_mode;
+
   // Change global theme
   lv_theme_t *th = lv_theme_default_init(disp,
                             lv_palette_main(LV_PALETTE_BLUE),
@@ -316,9 +595,17 @@ lv_theme_t *set_theme_mode(lv_disp_t *disp, bool dark_mode) {
       lv_style_set_bg_color(sty_tach, tacho_color);
 
     // Modify graphic tacho corner piece
-    obj = ui_panel_get_obj(&g_panels.instr, W_INSTR_TACH_C);
-    if(obj)
-      lv_obj_set_style_arc_color(obj, tacho_color, LV_PART_MAIN);
+#if USE_TACH_SPRITES
+    obj = ui_panel_get_obj(&g_panels.instr, W_INSTR_TACH_C_IND);
+    if(obj) {
+      tach_sprite_set_track_color(obj, tacho_color);
+    } else
+#endif
+    {
+      obj = ui_panel_get_obj(&g_panels.instr, W_INSTR_TACH_C);
+      if(obj)
+        lv_obj_set_style_arc_color(obj, tacho_color, LV_PART_MAIN);
+    }
   }
 
   return th;
@@ -412,7 +699,8 @@ static void mode_event_handler(lv_event_t *e) {
     };
     prop_set(&g_prop_db, P_APP_GUI_INFO__DARK, &entry, P_RSRC_GUI_LOCAL_WIDGET);
 
-    set_theme_mode(g_disp_main, checked);
+    // Let the switch finish handling its event before restyling everything
+    gui__request_theme(checked);
   }
 }
 
@@ -439,31 +727,54 @@ static void speed_slider_event_cb(lv_event_t * e) {
     lv_obj_t *slider = lv_event_get_target(e);
     lv_obj_t *lbl_speed = ui_panel_get_obj(&g_panels.instr, W_INSTR_LBL_SPEED);
     lv_label_set_text_fmt(lbl_speed, "%3" PRIu32, (uint32_t)lv_slider_get_value(slider)*2);
+    ui_panel_value_reset(&g_panels.instr, W_INSTR_LBL_SPEED);
 }
 
+static void gui__set_tacho_corner(UIPanel *panel, int16_t pct) {
+#if USE_TACH_SPRITES
+  lv_obj_t *ind = ui_panel_get_obj(panel, W_INSTR_TACH_C_IND);
+  if(ind) {
+    tach_sprite_set_value(ind, pct);
+    return;
+  }
+#endif
+
+  // Arc widget when sprites aren't built or failed to render
+  lv_obj_t *tach_c = ui_panel_get_obj(panel, W_INSTR_TACH_C);
+  if(tach_c)
+    lv_arc_set_value(tach_c, pct);
+}
+
+
+// True when the tacho corner is drawn from pre-rendered sprites
+bool gui_tacho_sprites_active(void) {
+  return ui_panel_get_obj(&g_panels.instr, W_INSTR_TACH_C_IND) != NULL;
+}
+
+
 void update_tacho(uint16_t rpm) {
   const uint16_t corner_start = 1000;
   const uint16_t corner_end   = 2500;
   const uint16_t top_end      = 9500;
 
-  lv_obj_t *lbl_rpm = ui_panel_get_obj(&g_panels.instr, W_INSTR_LBL_RPM);
-  if(lbl_rpm)
+  UIPanel *panel = &g_panels.instr;
+
+  lv_obj_t *lbl_rpm = ui_panel_get_obj(panel, W_INSTR_LBL_RPM);
+  if(lbl_rpm && ui_panel_value_changed(panel, W_INSTR_LBL_RPM, rpm))
     lv_label_set_text_fmt(lbl_rpm, "%5u", rpm);
 
+  // Bar and arc setters return early when the value is unchanged
   uint32_t pct;
-  lv_obj_t *tach_c = ui_panel_get_obj(&g_panels.instr, W_INSTR_TACH_C);
-  if(!tach_c) return;
-
-  lv_obj_t *tach_v = ui_panel_get_obj(&g_panels.instr, W_INSTR_TACH_V);
+  lv_obj_t *tach_v = ui_panel_get_obj(panel, W_INSTR_TACH_V);
   if(!tach_v) return;
 
-  lv_obj_t *tach_h = ui_panel_get_obj(&g_panels.instr, W_INSTR_TACH_H);
+  lv_obj_t *tach_h = ui_panel_get_obj(panel, W_INSTR_TACH_H);
   if(!tach_h) return;
 
 
   if(rpm <= corner_start) {
     lv_bar_set_value(tach_h, 0, LV_ANIM_OFF);
-    lv_arc_set_value(tach_c, 0);
+    gui__set_tacho_corner(panel, 0);
 
     pct = (uint32_t)rpm * 100 / corner_start;
     lv_bar_set_value(tach_v, pct, LV_ANIM_OFF);
@@ -473,11 +784,11 @@ void update_tacho(uint16_t rpm) {
     lv_bar_set_value(tach_h, 0, LV_ANIM_OFF);
 
     pct = (uint32_t)(rpm-corner_start) * 100 / (corner_end - corner_start);
-    lv_arc_set_value(tach_c, pct);
+    gui__set_tacho_corner(panel, pct);
 
   } else {
     lv_bar_set_value(tach_v, 100, LV_ANIM_OFF);
-    lv_arc_set_value(tach_c, 100);
+    gui__set_tacho_corner(panel, 100);
 
     if(rpm < top_end)
       pct = (uint32_t)(rpm-corner_end) * 100 / (top_end - corner_end);
@@ -487,6 +798,28 @@ void update_tacho(uint16_t rpm) {
   }
 }
 
+#if USE_GUI_PROFILE
+static void set_tacho_rpm(void *obj, int32_t rpm) {
+  update_tacho(rpm);
+}
+
+
+// Sweep tacho through its full range to compare sprite and widget frame times
+static void gui__tacho_sweep_start(void) {
+  gui_profile_reset();
+
+  lv_anim_t sweep_a;
+  lv_anim_init(&sweep_a);
+  lv_anim_set_var(&sweep_a, &g_panels.instr);
+  lv_anim_set_exec_cb(&sweep_a, set_tacho_rpm);
+  lv_anim_set_values(&sweep_a, 0, TACHO_SWEEP_RPM);
+  lv_anim_set_time(&sweep_a, TACHO_SWEEP_MS);
+  lv_anim_set_playback_time(&sweep_a, TACHO_SWEEP_MS);
+  lv_anim_start(&sweep_a);
+}
+#endif
+
+
 static void rpm_slider_event_cb(lv_event_t * e) {
   lv_obj_t *slider = lv_event_get_target(e);
 
@@ -755,7 +1088,7 @@ static void sprint_click(lv_event_t *e) {
 
 
 void ui_instruments_init(UIPanel *panel) {
-  ui_panel_init(panel);
+  ui_panel_init(panel, W_INSTR_COUNT);
   lv_obj_t *label;
 
   lv_obj_clear_flag(g_panels.instr.screen, LV_OBJ_FLAG_SCROLLABLE);
@@ -772,21 +1105,39 @@ void ui_instruments_init(UIPanel *panel) {
   // Bar tacho
 
   // Corner part
-  lv_obj_t *tach_c = lv_arc_create(g_panels.instr.screen);
-  ui_panel_add_obj(panel, W_INSTR_TACH_C, tach_c);
-  lv_obj_set_size(tach_c, 80,80);
-  lv_arc_set_rotation(tach_c, 180);
-  lv_arc_set_bg_angles(tach_c, 0, 90);
-  lv_obj_set_style_arc_color(tach_c, TACHO_MAIN_COLOR_DARK, LV_PART_MAIN);
-  lv_obj_set_style_arc_color(tach_c, TACHO_IND_COLOR, LV_PART_INDICATOR);
-  lv_obj_set_style_arc_rounded(tach_c, false, LV_PART_MAIN);
-  lv_obj_set_style_arc_rounded(tach_c, false, LV_PART_INDICATOR);
-  lv_obj_set_style_arc_width(tach_c, TACHO_BAR_W, LV_PART_MAIN);
-  lv_obj_set_style_arc_width(tach_c, TACHO_BAR_W, LV_PART_INDICATOR);
-  lv_obj_remove_style(tach_c, NULL, LV_PART_KNOB);
-  lv_obj_clear_flag(tach_c, LV_OBJ_FLAG_CLICKABLE);
-  lv_obj_align(tach_c, LV_ALIGN_TOP_LEFT, 2,2);
-  lv_arc_set_value(tach_c, 0);
+  lv_obj_t *tach_c = NULL;
+#if USE_TACH_SPRITES
+  if(tach_sprite_init(TACHO_BAR_W, TACHO_IND_COLOR, TACHO_MAIN_COLOR_DARK)) {
+    // Container keeps the geometry of the arc widget so the bars align the same
+    tach_c = lv_obj_create(g_panels.instr.screen);
+    lv_obj_remove_style_all(tach_c);
+    ui_panel_add_obj(panel, W_INSTR_TACH_C, tach_c);
+    lv_obj_set_size(tach_c, 80,80);
+    lv_obj_clear_flag(tach_c, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_align(tach_c, LV_ALIGN_TOP_LEFT, 2,2);
+
+    lv_obj_t *tach_c_ind = tach_sprite_create(tach_c);
+    ui_panel_add_obj(panel, W_INSTR_TACH_C_IND, tach_c_ind);
+  }
+#endif
+
+  if(!tach_c) { // Sprites not built or failed to render
+    tach_c = lv_arc_create(g_panels.instr.screen);
+    ui_panel_add_obj(panel, W_INSTR_TACH_C, tach_c);
+    lv_obj_set_size(tach_c, 80,80);
+    lv_arc_set_rotation(tach_c, 180);
+    lv_arc_set_bg_angles(tach_c, 0, 90);
+    lv_obj_set_style_arc_color(tach_c, TACHO_MAIN_COLOR_DARK, LV_PART_MAIN);
+    lv_obj_set_style_arc_color(tach_c, TACHO_IND_COLOR, LV_PART_INDICATOR);
+    lv_obj_set_style_arc_rounded(tach_c, false, LV_PART_MAIN);
+    lv_obj_set_style_arc_rounded(tach_c, false, LV_PART_INDICATOR);
+    lv_obj_set_style_arc_width(tach_c, TACHO_BAR_W, LV_PART_MAIN);
+    lv_obj_set_style_arc_width(tach_c, TACHO_BAR_W, LV_PART_INDICATOR);
+    lv_obj_remove_style(tach_c, NULL, LV_PART_KNOB);
+    lv_obj_clear_flag(tach_c, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_align(tach_c, LV_ALIGN_TOP_LEFT, 2,2);
+    lv_arc_set_value(tach_c, 0);
+  }
 
   lv_style_t *sty_tach = ui_styles_get(&g_ui_styles, P_APP_GUI_STYLE__TACH);
   lv_style_t *sty_tach_ind = ui_styles_get(&g_ui_styles, P_APP_GUI_STYLE__TACH_IND);
@@ -1194,7 +1545,7 @@ void ui_instruments_init(UIPanel *panel) {
   lv_label_set_text(label, "Dark mode");
   lv_obj_align_to(label, sw, LV_ALIGN_OUT_RIGHT_MID, 4,0);
 
-  ui_react_widgets_bind(&g_react_widgets, P_APP_GUI_INFO__DARK, sw);
+  ui_react_widgets_bind(&g_react_widgets, &g_widget_reg, P_APP_GUI_INFO__DARK, sw);
 
 
   // Menu mode 
@@ -1208,7 +1559,7 @@ void ui_instruments_init(UIPanel *panel) {
   lv_label_set_text(label, "Menu");
   lv_obj_align_to(label, sw2, LV_ALIGN_OUT_RIGHT_MID, 4,0);
 
-  ui_react_widgets_bind(&g_react_widgets, P_APP_GUI_MENU__MODE, sw2);
+  ui_react_widgets_bind(&g_react_widgets, &g_widget_reg, P_APP_GUI_MENU__MODE, sw2);
 
 
 
@@ -1299,8 +1650,12 @@ void ui_instruments_init(UIPanel *panel) {
 
 
 // TS Cal panel widgets
-#define W_TS_CAL_TGT0   (P_APP_GUI_WIDGET_n | P3_ARR(0))
-#define W_TS_CAL_TGT1   (P_APP_GUI_WIDGET_n | P3_ARR(1))
+typedef enum {
+  W_TS_CAL_TGT0 = 0,
+  W_TS_CAL_TGT1,
+
+  W_TS_CAL_COUNT
+} TsCalWidgetId;
 
 
 bool g_use_touch_calibration = false;
@@ -1441,7 +1796,7 @@ static void cal_target_click(lv_event_t *e) {
 
 
 void ui_ts_cal_init(UIPanel *panel) {
-  ui_panel_init(panel);
+  ui_panel_init(panel, W_TS_CAL_COUNT);
 
   lv_obj_t *label;
 
@@ -1489,7 +1844,7 @@ static void animate_logo_loc(void *img, int32_t x) {
 
 
 void ui_splash_init(UIPanel *panel) {
-  ui_panel_init(panel);
+  ui_panel_init(panel, 0);
 
   // Logo
   lv_obj_t *logo = lv_img_create(g_panels.splash.screen);
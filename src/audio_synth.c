@@ -9,6 +9,8 @@
 #include "cstone/iqueue_int16_t.h"
 #include "sample_device.h"
 #include "audio_synth.h"
+#include "synth_stream.h"
+#include "audio_tap.h"
 #include "util/random.h"
 #include "util/intmath.h"
 
@@ -192,6 +194,7 @@ void synth_oscillator_init(SynthState *synth, SynthOscillator *osc, uint32_t fre
 
   osc->kind = kind;
   osc->frequency = frequency;
+  osc->stream = NULL;
 }
 
 
@@ -338,6 +341,11 @@ int16_t oscillator_step_output(SynthOscillator *osc, uint32_t increment) {
     //sample = osc->output + (int16_t)random_range32(&s_audio_prng, INT16_MIN, INT16_MAX);
     sample = saturate16((int32_t)osc->output + random_range32(&s_audio_prng, INT16_MIN, INT16_MAX));
     break;
+
+  case OSC_SAMPLE:
+    if(osc->stream)
+      sample = synth_stream_next(osc->stream);
+    break;
   }
 
   //osc->zero_crossing = ((osc->output ^ sample) & 0x1000) != 0;
@@ -391,6 +399,10 @@ static int32_t voice__step_output(SynthVoice *vox, uint32_t sample_rate, bool *u
 
   int32_t osc_sample = oscillator_step_output(&vox->osc, osc_increment);
 
+  // Release envelope once a sample stream has played out
+  if(vox->osc.kind == OSC_SAMPLE && vox->osc.stream && vox->osc.stream->finished)
+    vox->adsr.gate = false;
+
   // Generate marker from voice oscillator if LFO is inactive
   if(!lfo_active && oscillator__zero_cross_rise(&vox->osc))
     *update_marker = true;
@@ -452,6 +464,10 @@ static int32_t compress_audio(int32_t sample, int16_t threshold) {
 
 
 size_t synth_gen_samples(SynthState *synth, size_t gen_count) {
+  SynthStream *stream = __atomic_exchange_n(&synth->pending_stream, NULL, __ATOMIC_ACQUIRE);
+  if(stream)
+    synth__start_stream_voice(synth, stream);
+
   size_t q_count = iqueue_count__int16_t(synth->queue);
   if(q_count >= gen_count)  // Nothing to do
     return q_count;
@@ -489,6 +505,11 @@ size_t synth_gen_samples(SynthState *synth, size_t gen_count) {
 
   uint32_t samples_per_ms = synth->sample_rate / 1000;
 
+  // Copy of the mix for the capture tap
+  bool tap_active = audio_tap_active();
+  int16_t tap_block[AUDIO_TAP_BLOCK_SAMPLES];
+  size_t tap_count = 0;
+
   //for(size_t j = 0; j < gen_count; j++) {
   while(gen_count--) {
     if(synth->sample_count == 0) {  // Update all ADSR envelopes
@@ -536,6 +557,14 @@ size_t synth_gen_samples(SynthState *synth, size_t gen_count) {
     if(iqueue_push_one__int16_t(synth->queue, &sample) < 1) // Full queue
       break;
 
+    if(tap_active) {
+      tap_block[tap_count++] = sample;
+      if(tap_count == AUDIO_TAP_BLOCK_SAMPLES) {
+        audio_tap_write(tap_block, tap_count);
+        tap_count = 0;
+      }
+    }
+
     // Update timing for next period
     synth->sample_count++;
     if(synth->sample_count >= samples_per_ms) {
@@ -544,6 +573,9 @@ size_t synth_gen_samples(SynthState *synth, size_t gen_count) {
     }
   }
 
+  if(tap_count > 0)
+    audio_tap_write(tap_block, tap_count);
+
   return iqueue_count__int16_t(synth->queue);
 }
 
@@ -708,6 +740,52 @@ SynthVoice *synth_add_voice(SynthState *synth, uint8_t key, int inst) {
 }
 
 
+// Start a voice for a pending stream. Only called from the render loop so the
+// voice list is never modified by two tasks.
+static void synth__start_stream_voice(SynthState *synth, SynthStream *stream) {
+  SynthVoiceCfg cfg = {
+    .osc_kind = OSC_SAMPLE,
+    .lfo_kind = OSC_NONE,
+    .adsr = {
+      .attack   = 2,  // Short ramps to avoid clicks at the ends of the stream
+      .decay    = 0,
+      .sustain  = INT16_MAX,
+      .release  = 20,
+      .curve    = CURVE_LINEAR
+    }
+  };
+
+  uint8_t vi = synth__find_free_voice(synth);
+  SynthVoice *vox = &synth->voices[vi];
+
+  synth_voice_init(synth, vi, &cfg);
+  vox->key = 0;
+  vox->instrument = SYNTH_MAX_INSTRUMENTS; // Not matched by key press/release
+  vox->osc.stream = stream;
+
+  // Start envelope
+  vox->adsr.prev_gate = 0;
+  vox->adsr.gate = 1;
+
+  synth->next_voice = vi + 1;
+  if(synth->next_voice >= SYNTH_MAX_VOICES)
+    synth->next_voice = 0;
+
+  // Voice is set up. Let the filler task see it.
+  __atomic_store_n(&stream->voice, vi, __ATOMIC_RELEASE);
+}
+
+
+// Queue a primed sample stream to start on a voice at the next render. Safe to
+// call from any task. Returns false if a stream is already waiting to start.
+bool synth_add_stream_voice(SynthState *synth, struct SynthStream *stream) {
+  stream->voice = -1;
+  SynthStream *expected = NULL;
+  return __atomic_compare_exchange_n(&synth->pending_stream, &expected, stream,
+                                     /*weak*/false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+
 /*void synth_end_voice(SynthState *synth, uint8_t key) {*/
 /*  if(key >= SYNTH_MAX_KEYS) // Out of range*/
 /*    return;*/
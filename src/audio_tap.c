@@ -0,0 +1,304 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lib_cfg/build_config.h"
+#include "cstone/platform.h"
+#include "app_main.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cstone/rtos.h"
+#include "cstone/debug.h"
+#include "cstone/blocking_io.h"
+#include "util/minmax.h"
+
+#if USE_FILESYSTEM
+#  include "evfs.h"
+#endif
+#include "audio_tap.h"
+
+/*
+Audio capture tap
+
+The final mix from synth_gen_samples() is copied in small blocks into a single
+producer, single consumer ring. A low priority task drains the ring to a WAV or
+raw PCM file, or prints it to the console as hex. The render loop only adds a
+memcpy per block. If the drain task falls behind, whole blocks are dropped and
+counted rather than making the render loop wait.
+
+The render loop can't wake the drain task because it also runs from the SDL
+audio callback on hosted builds. The drain task blocks on a task notification
+while the tap is idle and only polls the ring while a capture is running.
+
+The ring is allocated on first use and never freed since the render loop may
+still be finishing a block when the tap stops. For the same reason head is
+only ever written by the render loop. A restart sets the rearm flag and the
+render loop drops blocks until the drain task has discarded the old contents
+by moving tail up to head.
+*/
+
+#define RING_MASK           (AUDIO_TAP_RING_SAMPLES - 1)
+#define TAP_TASK_MS         20  // Drain period while capturing
+#define WAV_HEADER_SIZE     44
+#define CONSOLE_LINE_SAMPLES  16
+
+_Static_assert((AUDIO_TAP_RING_SAMPLES & RING_MASK) == 0, "AUDIO_TAP_RING_SAMPLES must be a power of 2");
+
+
+volatile AudioTapState g_audio_tap_state = TAP_IDLE;
+
+typedef struct {
+  int16_t    *ring;
+  uint32_t    head;     // Written by render loop
+  uint32_t    tail;     // Written by drain task
+  uint32_t    captured;
+  uint32_t    dropped;
+  bool        rearm;    // Set on start. Drain task clears it after resetting tail.
+  uint32_t    sample_rate;
+  AudioTapSink sink;
+#if USE_FILESYSTEM
+  EvfsFile   *fh;
+#endif
+} AudioTap;
+
+static AudioTap s_tap;
+static TaskHandle_t s_tap_task = NULL;
+
+
+static inline void audio_tap__wake(void) {
+  if(s_tap_task)
+    xTaskNotifyGive(s_tap_task);
+}
+
+
+// Called from the render loop. Never blocks.
+void audio_tap_write(const int16_t *samples, size_t count) {
+  if(g_audio_tap_state != TAP_ACTIVE || __atomic_load_n(&s_tap.rearm, __ATOMIC_ACQUIRE))
+    return;
+
+  uint32_t head = s_tap.head;
+  uint32_t tail = __atomic_load_n(&s_tap.tail, __ATOMIC_ACQUIRE);
+
+  if(count > AUDIO_TAP_RING_SAMPLES - (head - tail)) { // Writer is behind
+    s_tap.dropped += count;
+    return;
+  }
+
+  size_t offset = head & RING_MASK;
+  size_t chunk = min(count, AUDIO_TAP_RING_SAMPLES - offset);
+  memcpy(&s_tap.ring[offset], samples, chunk * sizeof(*samples));
+  if(chunk < count) // Wrap around
+    memcpy(&s_tap.ring[0], &samples[chunk], (count - chunk) * sizeof(*samples));
+
+  __atomic_store_n(&s_tap.head, head + count, __ATOMIC_RELEASE);
+}
+
+
+// ******************** Sinks ********************
+
+#if USE_FILESYSTEM
+static inline void put_le16(uint8_t *buf, uint16_t value) {
+  buf[0] = value & 0xFF;
+  buf[1] = value >> 8;
+}
+
+static inline void put_le32(uint8_t *buf, uint32_t value) {
+  put_le16(buf, value & 0xFFFF);
+  put_le16(&buf[2], value >> 16);
+}
+
+
+static bool audio_tap__write_wav_header(EvfsFile *fh, uint32_t sample_rate, uint32_t data_bytes) {
+  uint8_t hdr[WAV_HEADER_SIZE];
+
+  memcpy(&hdr[0], "RIFF", 4);
+  put_le32(&hdr[4], WAV_HEADER_SIZE - 8 + data_bytes);
+  memcpy(&hdr[8], "WAVEfmt ", 8);
+  put_le32(&hdr[16], 16);             // fmt chunk size
+  put_le16(&hdr[20], 1);              // PCM
+  put_le16(&hdr[22], 1);              // Mono
+  put_le32(&hdr[24], sample_rate);
+  put_le32(&hdr[28], sample_rate * 2);  // Byte rate
+  put_le16(&hdr[32], 2);              // Block align
+  put_le16(&hdr[34], 16);             // Bits per sample
+  memcpy(&hdr[36], "data", 4);
+  put_le32(&hdr[40], data_bytes);
+
+  if(evfs_file_seek(fh, 0, EVFS_SEEK_TO) != EVFS_OK)
+    return false;
+
+  return evfs_file_write(fh, hdr, sizeof hdr) == (ptrdiff_t)sizeof hdr;
+}
+#endif
+
+
+static void audio_tap__console_write(const int16_t *samples, size_t count) {
+  static const char s_hex[] = "0123456789ABCDEF";
+  char line[CONSOLE_LINE_SAMPLES * 5 + 2];
+
+  while(count > 0) {
+    size_t line_samples = min(count, CONSOLE_LINE_SAMPLES);
+    char *pos = line;
+
+    for(size_t i = 0; i < line_samples; i++) {
+      uint16_t s = samples[i];
+      *pos++ = s_hex[(s >> 12) & 0xF];
+      *pos++ = s_hex[(s >> 8) & 0xF];
+      *pos++ = s_hex[(s >> 4) & 0xF];
+      *pos++ = s_hex[s & 0xF];
+      *pos++ = ' ';
+    }
+    pos[-1] = '\n';
+    *pos = '\0';
+    bfputs(line, stdout);
+
+    samples += line_samples;
+    count -= line_samples;
+  }
+}
+
+
+static bool audio_tap__sink_write(const int16_t *samples, size_t count) {
+  switch(s_tap.sink) {
+#if USE_FILESYSTEM
+  case TAP_SINK_WAV:
+  case TAP_SINK_RAW:
+    {
+      ptrdiff_t bytes = count * sizeof(*samples);
+      return evfs_file_write(s_tap.fh, samples, bytes) == bytes;
+    }
+#endif
+
+  case TAP_SINK_CONSOLE:
+    audio_tap__console_write(samples, count);
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+
+static void audio_tap__close(void) {
+#if USE_FILESYSTEM
+  if(s_tap.fh) {
+    if(s_tap.sink == TAP_SINK_WAV)
+      audio_tap__write_wav_header(s_tap.fh, s_tap.sample_rate, s_tap.captured * sizeof(int16_t));
+
+    evfs_file_close(s_tap.fh);
+    s_tap.fh = NULL;
+  }
+#endif
+
+  g_audio_tap_state = TAP_IDLE;
+}
+
+
+// ******************** Control ********************
+
+
+bool audio_tap_start(AudioTapSink sink, const char *path, uint32_t sample_rate) {
+  if(g_audio_tap_state != TAP_IDLE)
+    return false;
+
+  if(!s_tap.ring) {
+    s_tap.ring = (int16_t *)malloc(AUDIO_TAP_RING_SAMPLES * sizeof(*s_tap.ring));
+    if(!s_tap.ring)
+      return false;
+  }
+
+  // Render loop may still be finishing a block from the last capture. Leave
+  // head alone and let the drain task discard anything left in the ring.
+  __atomic_store_n(&s_tap.rearm, true, __ATOMIC_RELEASE);
+  s_tap.sample_rate = sample_rate;
+  s_tap.sink = sink;
+
+  if(sink != TAP_SINK_CONSOLE) {
+#if USE_FILESYSTEM
+    if(!path || evfs_open(path, &s_tap.fh, EVFS_WRITE | EVFS_OPEN_OR_NEW | EVFS_OVERWRITE) != EVFS_OK)
+      return false;
+
+    // Reserve space for the header. Sizes are filled in when the tap stops.
+    if(sink == TAP_SINK_WAV && !audio_tap__write_wav_header(s_tap.fh, sample_rate, 0)) {
+      audio_tap__close();
+      return false;
+    }
+#else
+    return false;
+#endif
+  }
+
+  g_audio_tap_state = TAP_ACTIVE;
+  audio_tap__wake();
+  return true;
+}
+
+
+// Request stop. The drain task flushes the ring and closes the file.
+void audio_tap_stop(void) {
+  if(g_audio_tap_state == TAP_ACTIVE) {
+    g_audio_tap_state = TAP_STOPPING;
+    audio_tap__wake();
+  }
+}
+
+
+void audio_tap_stats(AudioTapStats *stats) {
+  stats->captured = s_tap.captured;
+  stats->dropped  = s_tap.dropped;
+  stats->state    = g_audio_tap_state;
+}
+
+
+static void audio_tap__drain(void) {
+  AudioTapState state = g_audio_tap_state;
+  if(state == TAP_IDLE)
+    return;
+
+  if(s_tap.rearm) { // New capture
+    s_tap.captured = 0;
+    s_tap.dropped = 0;
+    __atomic_store_n(&s_tap.tail, __atomic_load_n(&s_tap.head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    __atomic_store_n(&s_tap.rearm, false, __ATOMIC_RELEASE);
+  }
+
+  uint32_t head = __atomic_load_n(&s_tap.head, __ATOMIC_ACQUIRE);
+
+  while(s_tap.tail != head) {
+    size_t offset = s_tap.tail & RING_MASK;
+    size_t chunk = min(head - s_tap.tail, AUDIO_TAP_RING_SAMPLES - offset);
+
+    if(!audio_tap__sink_write(&s_tap.ring[offset], chunk)) {
+      DPRINT("Audio tap write failed");
+      state = TAP_STOPPING;
+      break;
+    }
+
+    s_tap.captured += chunk;
+    __atomic_store_n(&s_tap.tail, s_tap.tail + chunk, __ATOMIC_RELEASE);
+  }
+
+  if(state == TAP_STOPPING)
+    audio_tap__close();
+}
+
+
+static void audio_tap__task(void *ctx) {
+  while(1) {
+    // Sleep until audio_tap_start() when idle
+    TickType_t sleep = (g_audio_tap_state == TAP_IDLE) ? portMAX_DELAY : pdMS_TO_TICKS(TAP_TASK_MS);
+    ulTaskNotifyTake(/*xClearCountOnExit*/ pdTRUE, sleep);
+
+    audio_tap__drain();
+  }
+}
+
+
+void audio_tap_task_init(void) {
+  // Lowest priority so slow sinks never delay rendering
+  xTaskCreate(audio_tap__task, "atap", STACK_BYTES(1024), NULL, TASK_PRIO_LOW, &s_tap_task);
+}
@@ -1,7 +1,9 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <time.h>
 
@@ -13,8 +15,10 @@
 
 #include "cstone/console.h"
 #include "cstone/term_color.h"
+#include "cstone/profile.h"
 
 #include "util/mempool.h"
+#include "util/histogram.h"
 #include "cstone/blocking_io.h"
 
 #include "bsd/string.h"
@@ -24,6 +28,7 @@
 #include "util/string_ops.h"
 #include "util/glob.h"
 #include "evfs.h"
+#include "app_main.h"
 #include "cmds_filesys.h"
 
 
@@ -82,38 +87,160 @@ static unsigned scale_to_si(unsigned value, unsigned scale, char *si_prefix) {
 }
 
 
+// Format size with SI prefix into buf[10] padded to width. Shows tenths for values below 10.
+static void format_si_size(char *buf, evfs_off_t size, unsigned width) {
+  char si_prefix;
+
+  // Convert to fixed point with SI exponent
+  unsigned scaled_size = scale_to_si(size, 10, &si_prefix);
+  if(scaled_size >= 10*10 && si_prefix != '\0') { // Remove fraction if integer portion >= 10
+    scaled_size += 10;  // Ceiling rather than round with +0.5 to approximate GNU ls behavior
+    scaled_size = (scaled_size / 10) * 10;
+  }
+
+  AppendRange rng;
+  range_init(&rng, buf, 10);
+  unsigned pad_digits = width + 1;
+  if(si_prefix == '\0') // No prefix so use additional character for padding
+    pad_digits++;
+
+  // Show tenths unless the value is a round integer
+  unsigned frac_places = 1;
+  if((scaled_size / 10) * 10 == scaled_size)  // No fractional part
+    frac_places = 0;
+
+  // Format fixed point into string
+  range_cat_fixed_padded(&rng, scaled_size, 10, frac_places, pad_digits);
+  if(si_prefix != '\0')
+    range_cat_char(&rng, si_prefix);
+}
+
+
+// Directories with more matching entries than fit in the sort buffer are
+// streamed unsorted in directory order with an estimated column width
+#define LS_SORT_MAX_NAMES   128
+#define LS_SORT_NAME_BYTES  (LS_SORT_MAX_NAMES * 16)
+#define LS_MAX_COL_WIDTH    32  // Limit on estimated width for streamed columns
+#define LS_SIZE_WIDTH       8   // Width of size field in detail listing
+#define LS_OUT_BUF_SIZE     256
+
 // Config settings for cmd_ls print functions
 struct LsConfig {
   char *path_buf;   // Buffer for constructing paths
   const char *glob; // Optional glob match pattern
   const char *dir_name; // Optional subdirectory name
+  size_t name_pos;  // Offset of file name in path_buf after first join
+  bool  have_name_pos; // name_pos is set. A root dir prefix can leave it at 0
   int   term_width; // Width of the terminal
   int   size_width; // Width of the file size field
-  int   name_width; // Width of the longest file name
-  int   name_count; // Number of files to list
-  size_t total_name_len;  // Total length of all file names
   bool  have_mtime; // mtime is available from the filesystem
   bool  need_stat;  // evfs_stat() needs to be called for mtime or file size
   bool  si_sizes;   // Show size with SI units
 };
 
+// Output is accumulated so the console isn't written for every field
+typedef struct {
+  char   *buf;
+  size_t  len;
+} LsOutput;
+
+
+static void ls__flush(LsOutput *out) {
+  if(out->len == 0)
+    return;
+
+  out->buf[out->len] = '\0';
+  bfputs(out->buf, stdout);
+  out->len = 0;
+}
+
+
+static void ls__put_char(LsOutput *out, char ch) {
+  if(out->len >= LS_OUT_BUF_SIZE-1)
+    ls__flush(out);
+
+  out->buf[out->len++] = ch;
+}
+
+
+static void ls__put_str(LsOutput *out, const char *str) {
+  while(*str != '\0') {
+    ls__put_char(out, *str++);
+  }
+}
+
+
+static void ls__pad(LsOutput *out, int count) {
+  while(count-- > 0) {
+    ls__put_char(out, ' ');
+  }
+}
+
+
+static void ls__printf(LsOutput *out, const char *fmt, ...) {
+  va_list args;
+
+  for(int attempt = 0; attempt < 2; attempt++) {
+    size_t avail = LS_OUT_BUF_SIZE - out->len;
+
+    va_start(args, fmt);
+    int len = vsnprintf(&out->buf[out->len], avail, fmt, args);
+    va_end(args);
+
+    if(len < 0)
+      return;
+
+    if((size_t)len < avail || out->len == 0) { // Fits or truncated in an empty buffer
+      out->len += ((size_t)len < avail) ? (size_t)len : avail-1;
+      return;
+    }
+
+    ls__flush(out); // Retry with empty buffer
+  }
+}
+
 
 static inline bool file__glob(const char *pattern, EvfsInfo *info) {
   return glob_match(pattern, info->name, "/\\");
 }
 
 
-static void ls__print_detail(EvfsDir *dh, struct LsConfig *cfg) {
-  EvfsInfo info;
-  EvfsInfo stat;
+// Build full path to a directory entry in cfg->path_buf. Returns NULL if it doesn't fit.
+static const char *ls__entry_path(struct LsConfig *cfg, const char *name) {
+  size_t name_len = strlen(name);
+
+  if(!cfg->have_name_pos) {  // Join first entry to find where names start after the dir prefix
+    StringRange path_r;
+    StringRange file_name_r;
+    StringRange file_path_r;
+
+    size_t prefix_len = strlen(cfg->path_buf);
+    range_init(&path_r, cfg->path_buf, prefix_len);
+    range_init(&file_name_r, (char *)name, name_len);
+    range_init(&file_path_r, cfg->path_buf, EVFS_MAX_PATH);
+    evfs_path_join(&path_r, &file_name_r, &file_path_r);
+
+    size_t path_len = strlen(cfg->path_buf);
+    if(path_len >= name_len && !strcmp(&cfg->path_buf[path_len - name_len], name)) {
+      cfg->name_pos = path_len - name_len;
+      cfg->have_name_pos = true;
+    } else {  // Truncated join. Restore the dir prefix for the next entry.
+      cfg->path_buf[prefix_len] = '\0';
+      return NULL;
+    }
 
-  StringRange path_r;
-  range_init(&path_r, cfg->path_buf, strlen(cfg->path_buf));
-  StringRange file_name_r;
-  StringRange file_path_r;
-  range_init(&file_path_r, cfg->path_buf, EVFS_MAX_PATH);
+  } else {  // Reuse the prefix from the first join
+    strlcpy(&cfg->path_buf[cfg->name_pos], name, EVFS_MAX_PATH - cfg->name_pos);
+  }
+
+  return cfg->path_buf;
+}
 
 
+static void ls__print_detail(EvfsDir *dh, struct LsConfig *cfg, LsOutput *out) {
+  EvfsInfo info;
+  EvfsInfo stat;
+
   // Print file data
   evfs_dir_rewind(dh);
   while(evfs_dir_read(dh, &info) != EVFS_DONE) {
@@ -121,46 +248,24 @@ static void ls__print_detail(EvfsDir *dh, struct LsConfig *cfg) {
       continue;
 
     if(cfg->need_stat) {
-      range_init(&file_name_r, info.name, strlen(info.name));
-      evfs_path_join(&path_r, &file_name_r, &file_path_r);
-      evfs_stat(file_path_r.start, &stat);
+      const char *path = ls__entry_path(cfg, info.name);
+      if(!path || evfs_stat(path, &stat) != EVFS_OK)
+        stat = info;  // Fall back to the dir entry data
     }
 
     // Print file size
     if(info.type & EVFS_FILE_DIR) { // Directory
-      bprintf("D %*s", cfg->size_width, "");
+      ls__printf(out, "D %*s", cfg->size_width, "");
     } else { // File
       evfs_off_t file_size = cfg->need_stat ? stat.size : info.size;
 
       if(cfg->si_sizes) {  // Print human friendly size value with SI units
-        char si_prefix;
-
-        // Convert to fixed point with SI exponent
-        unsigned scaled_size = scale_to_si(file_size, 10, &si_prefix);
-        if(scaled_size >= 10*10 && si_prefix != '\0') { // Remove fraction if integer portion >= 10
-          scaled_size += 10;  // Ceiling rather than round with +0.5 to approximate GNU ls behavior
-          scaled_size = (scaled_size / 10) * 10;
-        }
-
         char buf[10];
-        AppendRange rng = RANGE_FROM_ARRAY(buf);
-        unsigned pad_digits = cfg->size_width + 1;
-        if(si_prefix == '\0') // No prefix so use additional character for padding
-          pad_digits++;
-
-        // Show tenths unless the value is a round integer
-        unsigned frac_places = 1;
-        if((scaled_size / 10) * 10 == scaled_size)  // No fractional part
-          frac_places = 0;
-
-        // Format fixed point into string
-        range_cat_fixed_padded(&rng, scaled_size, 10, frac_places, pad_digits);
-        if(si_prefix != '\0')
-          range_cat_char(&rng, si_prefix);
-        fputs(buf, stdout);
+        format_si_size(buf, file_size, cfg->size_width);
+        ls__put_str(out, buf);
 
       } else {  // Full integer value
-        bprintf("  %*u", cfg->size_width, file_size);
+        ls__printf(out, "  %*u", cfg->size_width, (unsigned)file_size);
       }
     }
 
@@ -171,62 +276,109 @@ static void ls__print_detail(EvfsDir *dh, struct LsConfig *cfg) {
       struct tm local;
       localtime_r(&mtime, &local);
       strftime(buf, sizeof(buf), " %Y-%m-%d %H:%M", &local);
-      fputs(buf, stdout);
+      ls__put_str(out, buf);
     }
 
     // Print file name
+    ls__put_char(out, ' ');
     if(info.type & EVFS_FILE_DIR) {
-      printf(" " A_BBLU "%s" A_NONE "\n", info.name);
+      ls__put_str(out, A_BBLU);
+      ls__put_str(out, info.name);
+      ls__put_str(out, A_NONE);
     } else {
-      putc(' ', stdout);
-      puts(info.name);
+      ls__put_str(out, info.name);
     }
+    ls__put_char(out, '\n');
   }
 
+  ls__flush(out);
 }
 
 
-static int sort_names_cmp(const void *a, const void *b) {
-  return stricmp(*(const char**)a, *(const char**)b);
+// Print name with optional dir prefix padded to fill a column
+static void ls__print_name(LsOutput *out, struct LsConfig *cfg, const char *name, bool is_dir,
+                           int col_width) {
+  int name_len = strlen(name);
+
+  if(is_dir)
+    ls__put_str(out, A_BBLU);
+
+  if(cfg->dir_name && cfg->glob) {  // Show dir prefix
+    ls__put_str(out, cfg->dir_name);
+    ls__put_char(out, '/');
+    name_len += strlen(cfg->dir_name) + 1;
+  }
+  ls__put_str(out, name);
+
+  if(is_dir)
+    ls__put_str(out, A_NONE);
+
+  ls__pad(out, col_width - name_len);
 }
 
 
-static bool ls__print_columns(EvfsDir *dh, struct LsConfig *cfg) {
-  bool rval = true;
+// Print names in directory order without buffering them. Names wider than
+// the estimated column width span multiple columns.
+static void ls__print_stream(EvfsDir *dh, struct LsConfig *cfg, LsOutput *out, int col_width) {
+  int cols = cfg->term_width / (col_width + 2);
+  if(cols == 0)
+    cols = 1;
+
+  int prefix_len = (cfg->dir_name && cfg->glob) ? strlen(cfg->dir_name) + 1 : 0;
+  int col = 0;
+  EvfsInfo info;
 
-  char *file_name = NULL;
-  char *name_buf = NULL;
-  char **sorted_names = NULL;
-  char *name_buf_pos;
-  int sorted_pos, cols, stride;
+  evfs_dir_rewind(dh);
+  while(evfs_dir_read(dh, &info) != EVFS_DONE) {
+    if(cfg->glob && !file__glob(cfg->glob, &info))
+      continue;
 
-  // Get buffer for formatted file name
-  int col_width = cfg->name_width;
-  if(cfg->dir_name && cfg->glob) // Include dir name on each file
-    col_width += strlen(cfg->dir_name) + 1; // Dir + separator
+    int name_len = strlen(info.name) + prefix_len;
+    int span = (name_len + 2 + col_width+1) / (col_width + 2);
 
-  file_name = (char *)mp_alloc(mp_sys_pools(), col_width+1, NULL);
-  if(!file_name) {
-    rval = false;
-    goto cleanup;
-  }
+    if(col > 0 && col + span > cols) {  // Doesn't fit on this row
+      ls__put_char(out, '\n');
+      col = 0;
+    }
 
-  // Build array of file names with attribute byte
-  //    [attr][name][\0][attr][name][\0]...
-  name_buf = (char *)malloc(cfg->total_name_len + cfg->name_count*2);
-  if(!name_buf) {
-    rval = false;
-    goto cleanup;
-  }
+    ls__print_name(out, cfg, info.name, info.type & EVFS_FILE_DIR, span*(col_width + 2) - 2);
+    col += span;
 
-  sorted_names = (char **)malloc(cfg->name_count * sizeof(char *));
-  if(!sorted_names) {
-    rval = false;
-    goto cleanup;
+    // Column separator or newline
+    if(col < cols) {
+      ls__put_str(out, "  ");
+    } else {
+      ls__put_char(out, '\n');
+      col = 0;
+    }
   }
 
-  name_buf_pos = name_buf;
-  sorted_pos = 0;
+  if(col > 0)
+    ls__put_char(out, '\n');
+
+  ls__flush(out);
+}
+
+
+static int sort_names_cmp(const void *a, const void *b) {
+  return stricmp(*(const char**)a, *(const char**)b);
+}
+
+
+static bool ls__print_columns(EvfsDir *dh, struct LsConfig *cfg, LsOutput *out) {
+  // Sort buffer has a fixed size. Pointers are followed by file names with attribute byte
+  //    [attr][name][\0][attr][name][\0]...
+  // Falls back to detail listing if the pool can't supply a buffer
+  char **sorted_names = (char **)mp_alloc(mp_sys_pools(),
+                                          LS_SORT_MAX_NAMES * sizeof(char *) + LS_SORT_NAME_BYTES, NULL);
+  if(!sorted_names)
+    return false;
+
+  char *name_buf_pos = (char *)&sorted_names[LS_SORT_MAX_NAMES];
+  char *name_buf_end = name_buf_pos + LS_SORT_NAME_BYTES;
+  int name_count = 0;
+  int name_width = 0;
+  bool overflow = false;
 
   EvfsInfo info;
 
@@ -235,7 +387,15 @@ static bool ls__print_columns(EvfsDir *dh, struct LsConfig *cfg) {
     if(cfg->glob && !file__glob(cfg->glob, &info))
       continue;
 
-    size_t name_len = strlen(info.name);
+    int name_len = strlen(info.name);
+    if(name_len > name_width)
+      name_width = name_len;
+
+    if(name_count >= LS_SORT_MAX_NAMES || name_buf_pos + name_len+2 > name_buf_end) {
+      overflow = true;
+      break;
+    }
+
     // Set attribute byte
     *name_buf_pos = (info.type & EVFS_FILE_DIR) ? 1 : 0;
     name_buf_pos++;
@@ -243,71 +403,54 @@ static bool ls__print_columns(EvfsDir *dh, struct LsConfig *cfg) {
     // Copy name
     memcpy(name_buf_pos, info.name, name_len+1);
 
-    sorted_names[sorted_pos++] = name_buf_pos;
+    sorted_names[name_count++] = name_buf_pos;
     name_buf_pos += name_len+1;
   }
 
-  qsort(sorted_names, cfg->name_count, sizeof(char *), sort_names_cmp);
+  int col_width = name_width;
+  if(cfg->dir_name && cfg->glob) // Include dir name on each file
+    col_width += strlen(cfg->dir_name) + 1; // Dir + separator
+
+  if(overflow) {  // Too many to sort. Use widths seen so far as an estimate.
+    mp_free(mp_sys_pools(), sorted_names);
+    ls__print_stream(dh, cfg, out, col_width < LS_MAX_COL_WIDTH ? col_width : LS_MAX_COL_WIDTH);
+    return true;
+  }
+
+  qsort(sorted_names, name_count, sizeof(char *), sort_names_cmp);
 
 
   // Get layout geometry
-  cols = cfg->term_width / (col_width + 2);
+  int cols = cfg->term_width / (col_width + 2);
   if(cols == 0)
     cols = 1;
 
-  stride = (cfg->name_count + cols-1) / cols;
+  int stride = (name_count + cols-1) / cols;
 
   // Print names
-  sorted_pos = 0;
   for(int r = 0; r < stride; r++) {
     for(int c = 0; c < cols; c++) {
       int name_ix = r + c*stride;
-      if(name_ix >= cfg->name_count) { // Out of range, last column ended
-        putnl();
+      if(name_ix >= name_count) { // Out of range, last column ended
+        ls__put_char(out, '\n');
         break;
       }
 
-      // Build name with optional dir prefix
-      AppendRange fn_r;
-      range_init(&fn_r, file_name, col_width+1);
-      if(cfg->dir_name && cfg->glob) {  // Show dir prefix
-        range_cat_str(&fn_r, cfg->dir_name);
-        range_cat_char(&fn_r, '/');
-      }
-      range_cat_str(&fn_r, sorted_names[name_ix]);
-
-      range_init(&fn_r, file_name, col_width+1);
-      range_pad_right((StringRange *)&fn_r, ' '); // Fill out column
-
-
       char attr = sorted_names[name_ix][-1];
-
-      if(attr)
-        fputs(A_BBLU, stdout);
-
-      if(c == 0)
-        bfputs(file_name, stdout);
-      else
-        fputs(file_name, stdout);
-
-      if(attr)
-        fputs(A_NONE, stdout);
-
+      ls__print_name(out, cfg, sorted_names[name_ix], attr, col_width);
 
       // Column separator or newline
       if(c < cols-1)
-        fputs("  ", stdout);
+        ls__put_str(out, "  ");
       else
-        putnl();
+        ls__put_char(out, '\n');
     }
   }
 
-cleanup:
-  if(file_name)     mp_free(mp_sys_pools(), file_name);
-  if(name_buf)      free(name_buf);
-  if(sorted_names)  free(sorted_names);
+  ls__flush(out);
+  mp_free(mp_sys_pools(), sorted_names);
 
-  return rval;
+  return true;
 }
 
 
@@ -372,8 +515,13 @@ static int32_t cmd_ls(uint8_t argc, char *argv[], void *eval_ctx) {
   EvfsDir *dh;
   int status = evfs_open_dir(path, &dh);
   if(status == EVFS_OK) {
-    EvfsInfo info;
-    EvfsInfo stat;
+    LsOutput out = {0};
+    out.buf = (char *)mp_alloc(mp_sys_pools(), LS_OUT_BUF_SIZE, NULL);
+    if(!out.buf) {
+      evfs_dir_close(dh);
+      mp_free(mp_sys_pools(), path);
+      return 1;
+    }
 
     // Get filesystem capabilities
     unsigned stat_fields;
@@ -385,44 +533,8 @@ static int32_t cmd_ls(uint8_t argc, char *argv[], void *eval_ctx) {
     cfg.have_mtime  = have_mtime;
     cfg.need_stat   = !(dir_fields & EVFS_INFO_SIZE) || (have_mtime && !(dir_fields & EVFS_INFO_MTIME));
 
-
-    StringRange file_path_r; // Constructed path to dir entries
-    range_init(&file_path_r, path, EVFS_MAX_PATH);
-
-    if(si_sizes)  // Fixed column width for sizes with SI values
-      cfg.size_width = 4+1;
-
-    // Scan through files to find width of name and size fields
-    evfs_off_t max_size = 0;
-    while(evfs_dir_read(dh, &info) != EVFS_DONE) {
-      if(cfg.glob && !file__glob(cfg.glob, &info))
-        continue;
-
-      int name_len = strlen(info.name);
-      cfg.total_name_len += name_len;
-      cfg.name_count++;
-      if(name_len > cfg.name_width)
-        cfg.name_width = name_len;
-
-      if(cfg.size_width == 0) { // Look for largest file
-        if(dir_fields & EVFS_INFO_SIZE) {
-          if(info.size > max_size)
-            max_size = info.size;
-        } else { // Have to stat files for size
-          range_init(&file_name_r, info.name, strlen(info.name));
-          evfs_path_join(&path_r, &file_name_r, &file_path_r);
-          evfs_stat(path, &stat);
-          if(stat.size > max_size)
-            max_size = stat.size;
-        }
-      }
-    }
-
-    if(cfg.size_width == 0)
-      cfg.size_width = base10_digits((uint32_t)max_size);
-
-
-    range_set_len(&file_path_r, range_size(&path_r)); // Strip off joined file
+    // Fixed field width so the directory is only read once
+    cfg.size_width  = si_sizes ? 4+1 : LS_SIZE_WIDTH;
     cfg.path_buf    = path;
 
     Console *con = active_console();
@@ -430,12 +542,13 @@ static int32_t cmd_ls(uint8_t argc, char *argv[], void *eval_ctx) {
 
     bool success = false;
     if(!show_detail)
-      success = ls__print_columns(dh, &cfg);
+      success = ls__print_columns(dh, &cfg, &out);
 
     // Show detail print if chosen by option or columnar print failed
     if(!success)
-      ls__print_detail(dh, &cfg);
+      ls__print_detail(dh, &cfg, &out);
 
+    mp_free(mp_sys_pools(), out.buf);
     evfs_dir_close(dh);
   }
 
@@ -445,11 +558,524 @@ static int32_t cmd_ls(uint8_t argc, char *argv[], void *eval_ctx) {
 }
 
 
+// ******************** Directory tree walk ********************
+
+/*
+Directory trees are traversed iteratively with an explicit stack of open
+directory handles rather than by recursion. Only one handle is held per level
+and the depth is bounded so the console task stack and FreeRTOS heap use stay
+fixed no matter how many files are present. Subtrees deeper than the limit
+are counted and skipped. Directories that fail to open are counted separately.
+*/
+
+#define WALK_MAX_DEPTH  8
+
+typedef enum {
+  WALK_DONE = 0,
+  WALK_ENTRY,     // Entry info and path are valid
+  WALK_LEAVE      // Finished reading directory in path
+} WalkEvent;
+
+typedef struct {
+  char     *path;   // Path of current entry
+  EvfsDir  *dh[WALK_MAX_DEPTH];
+  uint16_t  path_len[WALK_MAX_DEPTH];  // Length of directory path at each level
+  int       depth;        // Current stack level. -1 when done.
+  int       entry_depth;  // Level of the directory containing the last entry
+  unsigned  skipped;      // Directories beyond WALK_MAX_DEPTH
+  unsigned  failed;       // Directories that couldn't be opened
+} FsWalk;
+
+
+static FsWalk *fs__walk_begin(const char *dir_name) {
+  FsWalk *walk = (FsWalk *)mp_alloc(mp_sys_pools(), sizeof(FsWalk), NULL);
+  if(!walk)
+    return NULL;
+
+  memset(walk, 0, sizeof(*walk));
+  walk->path = (char *)mp_alloc(mp_sys_pools(), EVFS_MAX_PATH, NULL);
+  if(!walk->path) {
+    mp_free(mp_sys_pools(), walk);
+    return NULL;
+  }
+
+  StringRange path_r;
+  range_init(&path_r, walk->path, EVFS_MAX_PATH);
+  evfs_get_cur_dir(&path_r);
+  if(dir_name) {  // path --> path/dir_name
+    StringRange dir_name_r;
+    range_init(&dir_name_r, (char *)dir_name, strlen(dir_name));
+    evfs_path_join(&path_r, &dir_name_r, &path_r);
+  }
+
+  if(evfs_open_dir(walk->path, &walk->dh[0]) != EVFS_OK) {
+    mp_free(mp_sys_pools(), walk->path);
+    mp_free(mp_sys_pools(), walk);
+    return NULL;
+  }
+
+  walk->path_len[0] = strlen(walk->path);
+  return walk;
+}
+
+
+static void fs__walk_end(FsWalk *walk) {
+  // Close any handles left open by an early exit
+  while(walk->depth >= 0) {
+    evfs_dir_close(walk->dh[walk->depth--]);
+  }
+
+  mp_free(mp_sys_pools(), walk->path);
+  mp_free(mp_sys_pools(), walk);
+}
+
+
+static void fs__walk_report(FsWalk *walk) {
+  if(walk->skipped > 0)
+    printf("Skipped %u dirs deeper than %d\n", walk->skipped, WALK_MAX_DEPTH);
+  if(walk->failed > 0)
+    printf("Failed to open %u dirs\n", walk->failed);
+}
+
+
+static WalkEvent fs__walk_next(FsWalk *walk, EvfsInfo *info) {
+  while(walk->depth >= 0) {
+    walk->path[walk->path_len[walk->depth]] = '\0'; // Trim to current directory
+
+    if(evfs_dir_read(walk->dh[walk->depth], info) == EVFS_DONE) {
+      evfs_dir_close(walk->dh[walk->depth]);
+      walk->depth--;
+      return WALK_LEAVE;
+    }
+
+    if(!strcmp(info->name, ".") || !strcmp(info->name, ".."))
+      continue;
+
+    StringRange path_r;
+    StringRange file_name_r;
+    StringRange file_path_r;
+    range_init(&path_r, walk->path, walk->path_len[walk->depth]);
+    range_init(&file_name_r, (char *)info->name, strlen(info->name));
+    range_init(&file_path_r, walk->path, EVFS_MAX_PATH);
+    evfs_path_join(&path_r, &file_name_r, &file_path_r);
+
+    walk->entry_depth = walk->depth;
+
+    if(info->type & EVFS_FILE_DIR) { // Descend
+      EvfsDir *dh;
+      if(walk->depth+1 >= WALK_MAX_DEPTH) {
+        walk->skipped++;
+      } else if(evfs_open_dir(walk->path, &dh) == EVFS_OK) {
+        walk->depth++;
+        walk->dh[walk->depth] = dh;
+        walk->path_len[walk->depth] = strlen(walk->path);
+      } else {
+        walk->failed++;
+      }
+    }
+
+    return WALK_ENTRY;
+  }
+
+  return WALK_DONE;
+}
+
+
+// Path relative to the current directory for display
+static const char *fs__walk_rel_path(FsWalk *walk, const char *dir_name, size_t cwd_len) {
+  const char *rel = walk->path + cwd_len;
+  while(*rel == '/' || *rel == '\\')
+    rel++;
+
+  return *rel == '\0' ? (dir_name ? dir_name : ".") : rel;
+}
+
+
+static size_t fs__cwd_len(void) {
+  char *cwd = (char *)mp_alloc(mp_sys_pools(), EVFS_MAX_PATH, NULL);
+  if(!cwd)
+    return 0;
+
+  StringRange cwd_r;
+  range_init(&cwd_r, cwd, EVFS_MAX_PATH);
+  evfs_get_cur_dir(&cwd_r);
+  size_t cwd_len = strlen(cwd);
+
+  mp_free(mp_sys_pools(), cwd);
+  return cwd_len;
+}
+
+
+static int32_t cmd_find(uint8_t argc, char *argv[], void *eval_ctx) {
+  GetoptState state = {0};
+  state.report_errors = true;
+  int c;
+
+  while((c = getopt_r(argv, "h", &state)) != -1) {
+    switch(c) {
+    case 'h':
+      puts("find [<dir>] <glob>");
+      return 0;
+      break;
+
+    default:
+    case ':':
+    case '?':
+      return -3;
+      break;
+    }
+  }
+
+  if(state.optind >= argc)
+    return -3;
+
+  const char *dir_name = (argc - state.optind >= 2) ? argv[state.optind++] : NULL;
+  const char *pattern = argv[state.optind];
+
+  size_t cwd_len = fs__cwd_len();
+  FsWalk *walk = fs__walk_begin(dir_name);
+  if(!walk)
+    return 1;
+
+  EvfsInfo info;
+  WalkEvent event;
+  unsigned matches = 0;
+
+  while((event = fs__walk_next(walk, &info)) != WALK_DONE) {
+    if(event == WALK_ENTRY && glob_match(pattern, info.name, "/\\")) {
+      bfputs(fs__walk_rel_path(walk, dir_name, cwd_len), stdout);
+      putnl();
+      matches++;
+    }
+  }
+
+  fs__walk_report(walk);
+
+  fs__walk_end(walk);
+
+  return matches > 0 ? 0 : 1;
+}
+
+
+static void du__print_size(uint64_t size, bool si_sizes, const char *path) {
+  if(si_sizes) {
+    char buf[10];
+    format_si_size(buf, size, 4);
+    printf("%s  %s\n", buf, path);
+  } else {  // Size in KiB rounded up
+    printf("%-8lu %s\n", (unsigned long)((size + 1023) / 1024), path);
+  }
+}
+
+
+static int32_t cmd_du(uint8_t argc, char *argv[], void *eval_ctx) {
+  GetoptState state = {0};
+  state.report_errors = true;
+  int c;
+
+  bool si_sizes = false;
+  bool summarize = false;
+
+  // -h is human readable sizes as with ls
+  while((c = getopt_r(argv, "sh", &state)) != -1) {
+    switch(c) {
+    case 'h': si_sizes = true; break;
+    case 's': summarize = true; break;
+
+    default:
+    case ':':
+    case '?':
+      return -3;
+      break;
+    }
+  }
+
+  const char *dir_name = (state.optind < argc) ? argv[state.optind] : NULL;
+
+  unsigned stat_fields;
+  unsigned dir_fields;
+  evfs_vfs_ctrl(EVFS_CMD_GET_STAT_FIELDS, &stat_fields);
+  evfs_vfs_ctrl(EVFS_CMD_GET_DIR_FIELDS, &dir_fields);
+  bool need_stat = !(dir_fields & EVFS_INFO_SIZE);
+
+  size_t cwd_len = fs__cwd_len();
+  FsWalk *walk = fs__walk_begin(dir_name);
+  if(!walk)
+    return 1;
+
+  uint64_t dir_size[WALK_MAX_DEPTH] = {0}; // Running total for each open directory
+  EvfsInfo info;
+  EvfsInfo stat;
+  WalkEvent event;
+
+  while((event = fs__walk_next(walk, &info)) != WALK_DONE) {
+    if(event == WALK_ENTRY) {
+      if(info.type & EVFS_FILE_DIR) {
+        if(walk->depth > walk->entry_depth) // Descended into new dir
+          dir_size[walk->depth] = 0;
+
+      } else {
+        evfs_off_t size = info.size;
+        if(need_stat && evfs_stat(walk->path, &stat) == EVFS_OK)
+          size = stat.size;
+        dir_size[walk->entry_depth] += size;
+      }
+
+    } else { // WALK_LEAVE: Report finished dir and add to parent
+      int level = walk->depth + 1;
+      if(!summarize || level == 0)
+        du__print_size(dir_size[level], si_sizes, fs__walk_rel_path(walk, dir_name, cwd_len));
+
+      if(walk->depth >= 0)
+        dir_size[walk->depth] += dir_size[level];
+    }
+  }
+
+  fs__walk_report(walk);
+
+  fs__walk_end(walk);
+
+  return 0;
+}
+
+
+// ******************** Filesystem benchmark ********************
+
+// Only the stdio VFS is registered by filesystem_init(). On embedded targets it
+// sits on the newlib syscall stubs and there is no flash or SD backend, so
+// results there only measure EVFS overhead. Hosted results measure the host
+// filesystem.
+
+#define FSBENCH_MAX_BLOCK   (16 * 1024)
+#define FSBENCH_HIST_BINS   20    // Linear latency bins with overflow
+#define FSBENCH_HIST_MAX_US 2000
+
+typedef struct {
+  const char *name;
+  uint32_t    prof_id;
+  Histogram  *hist;
+  uint32_t    count;
+  uint32_t    total_us;
+  uint32_t    max_us;
+  bool        failed;
+} FsBenchOp;
+
+
+static void fsbench__op_reset(FsBenchOp *op, const char *name) {
+  if(!op->name) { // Profile and histogram are kept across runs
+    op->name = name;
+    op->prof_id = profile_add(0, name);
+    op->hist = histogram_init(FSBENCH_HIST_BINS, 0, FSBENCH_HIST_MAX_US, /* track_overflow */ true);
+  } else if(op->hist) {
+    histogram_reset(op->hist);
+  }
+
+  op->count = 0;
+  op->total_us = 0;
+  op->max_us = 0;
+  op->failed = false;
+}
+
+
+// Returns elapsed_mark() at start of op
+static inline uint32_t fsbench__op_start(FsBenchOp *op) {
+  profile_start(op->prof_id);
+  return elapsed_mark();
+}
+
+
+static void fsbench__op_stop(FsBenchOp *op, uint32_t start, bool ok) {
+  uint32_t elapsed = elapsed_us(start);
+  profile_stop(op->prof_id);
+
+  if(!ok)
+    op->failed = true;
+
+  op->count++;
+  op->total_us += elapsed;
+  if(elapsed > op->max_us)
+    op->max_us = elapsed;
+
+  if(op->hist)
+    histogram_add_sample(op->hist, elapsed);
+}
+
+
+static void fsbench__report(FsBenchOp *op, size_t bytes) {
+  if(op->count == 0)
+    return;
+
+  printf("%-9s %5" PRIu32 " ops  avg %5" PRIu32 " us  max %6" PRIu32 " us", op->name,
+          op->count, op->total_us / op->count, op->max_us);
+
+  if(op->failed) {
+    fputs(A_BRED "  FAILED" A_NONE, stdout);
+  } else if(bytes > 0 && op->total_us > 0) { // Bytes per us == MB/s
+    uint32_t rate_x100 = (uint64_t)bytes * 100 / op->total_us;
+    printf("  %3" PRIu32 ".%02" PRIu32 " MB/s", rate_x100 / 100, rate_x100 % 100);
+  }
+  putnl();
+
+  if(op->hist)
+    histogram_plot(op->hist, 40);
+}
+
+
+static int32_t cmd_fsbench(uint8_t argc, char *argv[], void *eval_ctx) {
+  GetoptState state = {0};
+  state.report_errors = true;
+  int c;
+
+  size_t block_size = 512;
+  unsigned block_count = 64;
+  const char *path = "fsbench.dat";
+
+  while((c = getopt_r(argv, "b:n:f:h", &state)) != -1) {
+    switch(c) {
+    case 'b': block_size = strtoul(state.optarg, NULL, 0); break;
+    case 'n': block_count = strtoul(state.optarg, NULL, 0); break;
+    case 'f': path = state.optarg; break;
+
+    case 'h':
+      puts("fsbench [-b <block size>] [-n <block count>] [-f <file>] [-h]");
+      return 0;
+      break;
+
+    default:
+    case ':':
+    case '?':
+      return -3;
+      break;
+    }
+  }
+
+  if(block_size == 0 || block_size > FSBENCH_MAX_BLOCK || block_count == 0) {
+    printf("Block size must be 1 - %d\n", FSBENCH_MAX_BLOCK);
+    return -3;
+  }
+
+#ifdef PLATFORM_EMBEDDED
+  puts("Note: stdio VFS only. No storage backend to measure.");
+#endif
+
+  uint8_t *buf = (uint8_t *)malloc(block_size);
+  if(!buf)
+    return 1;
+
+  for(size_t i = 0; i < block_size; i++) {
+    buf[i] = i;
+  }
+
+  // Profiles are kept across runs for reporting with PROFile
+  static FsBenchOp s_ops[6];
+  FsBenchOp *op_create = &s_ops[0];
+  FsBenchOp *op_write  = &s_ops[1];
+  FsBenchOp *op_sync   = &s_ops[2];
+  FsBenchOp *op_read   = &s_ops[3];
+  FsBenchOp *op_seek   = &s_ops[4];
+  FsBenchOp *op_delete = &s_ops[5];
+
+  fsbench__op_reset(op_create, "fs create");
+  fsbench__op_reset(op_write,  "fs write");
+  fsbench__op_reset(op_sync,   "fs sync");
+  fsbench__op_reset(op_read,   "fs read");
+  fsbench__op_reset(op_seek,   "fs seek");
+  fsbench__op_reset(op_delete, "fs delete");
+
+  EvfsFile *fh;
+  int status;
+  uint32_t start;
+
+  // Create and write
+  start = fsbench__op_start(op_create);
+  status = evfs_open(path, &fh, EVFS_RDWR | EVFS_OPEN_OR_NEW | EVFS_OVERWRITE);
+  fsbench__op_stop(op_create, start, status == EVFS_OK);
+  if(status != EVFS_OK) {
+    printf("Open failed: %s\n", evfs_err_name(status));
+    free(buf);
+    return status;
+  }
+
+  for(unsigned i = 0; i < block_count; i++) {
+    start = fsbench__op_start(op_write);
+    ptrdiff_t written = evfs_file_write(fh, buf, block_size);
+    bool ok = written == (ptrdiff_t)block_size;
+    fsbench__op_stop(op_write, start, ok);
+    if(!ok) {
+      puts("Write failed");
+      break;
+    }
+  }
+
+  start = fsbench__op_start(op_sync);
+  status = evfs_file_sync(fh);
+  fsbench__op_stop(op_sync, start, status == EVFS_OK);
+
+  // Sequential read
+  if(evfs_file_seek(fh, 0, EVFS_SEEK_TO) != EVFS_OK)
+    op_read->failed = true;
+
+  for(unsigned i = 0; i < block_count && !op_read->failed; i++) {
+    start = fsbench__op_start(op_read);
+    ptrdiff_t read_bytes = evfs_file_read(fh, buf, block_size);
+    bool ok = read_bytes == (ptrdiff_t)block_size;
+    fsbench__op_stop(op_read, start, ok);
+    if(!ok) {
+      puts("Read failed");
+      break;
+    }
+  }
+
+  // Random block seek and read
+  uint32_t lfsr = 0xACE1u;
+  for(unsigned i = 0; i < block_count; i++) {
+    lfsr = lfsr * 1664525u + 1013904223u;
+    evfs_off_t offset = (evfs_off_t)((lfsr >> 8) % block_count) * block_size;
+
+    start = fsbench__op_start(op_seek);
+    bool ok = evfs_file_seek(fh, offset, EVFS_SEEK_TO) == EVFS_OK &&
+              evfs_file_read(fh, buf, block_size) == (ptrdiff_t)block_size;
+    fsbench__op_stop(op_seek, start, ok);
+    if(!ok) {
+      puts("Seek failed");
+      break;
+    }
+  }
+
+  evfs_file_close(fh);
+
+  start = fsbench__op_start(op_delete);
+  status = evfs_delete(path);
+  fsbench__op_stop(op_delete, start, status == EVFS_OK);
+
+  free(buf);
+
+  size_t total_bytes = block_size * block_count;
+  printf("%u x %u byte blocks\n", block_count, (unsigned)block_size);
+  fsbench__report(op_create, 0);
+  fsbench__report(op_write, total_bytes);
+  fsbench__report(op_sync, 0);
+  fsbench__report(op_read, total_bytes);
+  fsbench__report(op_seek, total_bytes);
+  fsbench__report(op_delete, 0);
+
+  for(unsigned i = 0; i < COUNT_OF(s_ops); i++) {
+    if(s_ops[i].failed)
+      return 1;
+  }
+
+  return 0;
+}
+
+
 const ConsoleCommandDef g_filesystem_cmd_set[] = {
 #ifndef PLATFORM_EMBEDDED
   CMD_DEF("cd",       cmd_cd,         "Change directory"),
   CMD_DEF("ls",       cmd_ls,         "List directory"),
   CMD_DEF("pwd",      cmd_pwd,        "Current directory"),
 #endif
+  CMD_DEF("du",       cmd_du,         "Disk usage [-h] [-s] [<dir>]"),
+  CMD_DEF("find",     cmd_find,       "Find files"),
+  CMD_DEF("fsbench",  cmd_fsbench,    "Filesystem benchmark"),
   CMD_END
 };
@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "lib_cfg/build_config.h"
 #include "lib_cfg/cstone_cfg_stm32.h"
@@ -17,10 +18,12 @@
 #  include "stm32f429i_discovery.h"
 #  include "stm32f429i_discovery_lcd.h"
 #  include "stm32f429i_discovery_ts.h"
+#  include "stm32f4xx_ll_dma2d.h"
 //#  include "stm32f4xx_it.h"
 #endif
 
 #include "FreeRTOS.h"
+#include "task.h"
 #include "timers.h"
 
 
@@ -35,6 +38,9 @@
 #include "ui_panel.h"
 #include "ui_units.h"
 #include "app_ui.h"
+#if USE_GUI_PROFILE
+#  include "gui_profile.h"
+#endif
 
 #ifndef PLATFORM_EMBEDDED
 #  include "lv_drivers/sdl/sdl.h"
@@ -44,11 +50,15 @@
 #include "debounce.h"
 #include "util/getopt_r.h"
 
+#include "app_tasks.h"
 #include "disco_ui.hpp"
 
 // AHB burst transfers span 1K blocks and must be on a 64B boundary to avoid sequential access
 #define BURST_ALIGN       1024
-#define LCD_COLOR_DEPTH   32
+
+// LCD_COLOR_DEPTH is set in build_config.h. 16-bit frame buffers halve the
+// SDRAM bandwidth used by LTDC scan-out and flushes.
+static_assert(LV_COLOR_DEPTH == LCD_COLOR_DEPTH, "LVGL and LCD color depths differ");
 
 LV_IMG_DECLARE(cursor_v);
 
@@ -57,6 +67,51 @@ UIReactWidgets    g_react_widgets;  // Table of reactive widgets indexed by prop
 UIWidgetRegistry  g_widget_reg;     // Table of UIWidgetEntry indexed by type string
 
 
+/*
+The LVGL task sleeps while nothing is due. On embedded, input devices pause
+their read timers once they report a release and no scroll is in progress.
+The touch poll timer and nav button events then flag new input and wake the
+LVGL task, which resumes the read timers. The simulator keeps polling since
+SDL input isn't signaled.
+*/
+static volatile bool s_input_event = false;
+
+// Called from input sources in other tasks
+static void input__wake(void) {
+  s_input_event = true;
+  gui_task_wake();
+}
+
+
+// Called from the LVGL task before lv_timer_handler()
+void gui_input_resume(void) {
+  if(!s_input_event)
+    return;
+
+  s_input_event = false;
+  for(lv_indev_t *indev = lv_indev_get_next(NULL); indev; indev = lv_indev_get_next(indev)) {
+    if(indev->driver->read_timer)
+      lv_timer_resume(indev->driver->read_timer);
+  }
+}
+
+
+// Called from indev read callbacks while the indev is active
+static inline void input__pause_if_idle(lv_indev_drv_t *drv, lv_indev_data_t *data) {
+#ifdef PLATFORM_EMBEDDED
+  if(data->state != LV_INDEV_STATE_RELEASED || s_input_event)
+    return;
+
+  // LVGL runs the scroll throw after release from further reads. Keep polling
+  // until it ends and the scroll object is cleared, or the tileview won't snap.
+  if(drv->type == LV_INDEV_TYPE_POINTER && lv_indev_get_scroll_obj(lv_indev_get_act()))
+    return;
+
+  lv_timer_pause(drv->read_timer);
+#endif
+}
+
+
 #define NAV_BUTTON_TIMEOUT_MS 200
 static uint32_t s_nav_button_event = P_EVENT_BUTTON__UP_PRESS;
 static TickType_t s_nav_button_timestamp = 0;
@@ -64,6 +119,7 @@ static TickType_t s_nav_button_timestamp = 0;
 void set_nav_button_state(uint32_t event) {
   s_nav_button_event = event;
   s_nav_button_timestamp = xTaskGetTickCount();
+  input__wake();
 }
 
 static uint32_t get_nav_button_state(bool *pressed) {
@@ -115,6 +171,7 @@ void nav_input_read(lv_indev_drv_t *drv, lv_indev_data_t *data) {
 
   data->key = last_key;
   data->state = pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+  input__pause_if_idle(drv, data);
 }
 
 
@@ -158,42 +215,189 @@ static void lcd_switch_buffer(lv_color_t *active_buf) {
 #  endif
 
 
-static void lcd_flush(lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t *color_p) {
+/*
+Draw buffers are copied with DMA2D. It signals completion with an interrupt so
+the LVGL task can sleep in lcd_flush_wait() rather than spin. LVGL's own DMA2D
+fill and blend ops share the unit but never overlap a flush because LVGL
+waits for the flush to finish before drawing again.
+
+With USE_DOUBLE_BUF, LVGL renders directly into the back frame buffer and only
+redraws invalidated areas. After the buffers are swapped on vsync, the areas
+drawn in the new front buffer are copied into the back buffer so it is current
+before LVGL draws the next frame into it.
+*/
+
+#  if LCD_COLOR_DEPTH == 16
+#    define DMA2D_INPUT_MODE   LL_DMA2D_INPUT_MODE_RGB565
+#    define DMA2D_OUTPUT_MODE  LL_DMA2D_OUTPUT_MODE_RGB565
+#  else
+#    define DMA2D_INPUT_MODE   LL_DMA2D_INPUT_MODE_ARGB8888
+#    define DMA2D_OUTPUT_MODE  LL_DMA2D_OUTPUT_MODE_ARGB8888
+#  endif
+
+static lv_disp_drv_t * volatile s_flush_disp = NULL;  // Flush in progress
+static volatile TaskHandle_t s_flush_waiter = NULL;
+
+
+// Start async copy of a rectangle. Strides are in pixels.
+static void lcd__dma2d_copy(const void *src, lv_coord_t src_stride, void *dest, lv_coord_t dest_stride,
+                            lv_coord_t w, lv_coord_t h) {
+  // Finish any LVGL GPU operation before taking over the DMA2D
+  while(LL_DMA2D_IsTransferOngoing(DMA2D)) {}
+
+  LL_DMA2D_SetMode(DMA2D, LL_DMA2D_MODE_M2M);  // Formats match; no conversion
+  LL_DMA2D_FGND_SetColorMode(DMA2D, DMA2D_INPUT_MODE);
+  LL_DMA2D_FGND_SetAlphaMode(DMA2D, LL_DMA2D_ALPHA_MODE_NO_MODIF);
+  LL_DMA2D_FGND_SetMemAddr(DMA2D, (uintptr_t)src);
+  LL_DMA2D_FGND_SetLineOffset(DMA2D, src_stride - w);
+
+  LL_DMA2D_SetOutputColorMode(DMA2D, DMA2D_OUTPUT_MODE);
+  LL_DMA2D_SetOutputMemAddr(DMA2D, (uintptr_t)dest);
+  LL_DMA2D_SetLineOffset(DMA2D, dest_stride - w);
+  LL_DMA2D_ConfigSize(DMA2D, h, w);
+
+  LL_DMA2D_ClearFlag_TC(DMA2D);
+  LL_DMA2D_EnableIT_TC(DMA2D);
+  LL_DMA2D_EnableIT_TE(DMA2D);
+  LL_DMA2D_Start(DMA2D);
+}
+
+
+// Complete flush from interrupt context
+static void lcd__flush_done(void) {
+  lv_disp_drv_t *disp_drv = s_flush_disp;
+  if(disp_drv) {
+    s_flush_disp = NULL;
+    lv_disp_flush_ready(disp_drv);
+  }
+
+  TaskHandle_t waiter = s_flush_waiter;
+  if(waiter) {
+    BaseType_t high_prio_task = pdFALSE;
+    vTaskNotifyGiveFromISR(waiter, &high_prio_task);
+    portYIELD_FROM_ISR(high_prio_task);
+  }
+}
+
+
+#  ifdef USE_DOUBLE_BUF
+// Areas rendered into the front buffer that must be copied to the back buffer
+static lv_area_t s_sync_areas[LV_INV_BUF_SIZE];
+static uint16_t s_sync_count = 0;
+static uint16_t s_sync_next = 0;
+static LCDPixel *s_sync_front;
+static LCDPixel *s_sync_back;
+
+
+// Start copying the next dirty area. Returns false when all are done.
+static bool lcd__sync_next(void) {
+  if(s_sync_next >= s_sync_count)
+    return false;
+
+  lv_area_t *area = &s_sync_areas[s_sync_next++];
+  size_t offset = area->y1 * LCD_HOR_SPAN + area->x1;
+  lcd__dma2d_copy(&s_sync_front[offset], LCD_HOR_SPAN, &s_sync_back[offset], LCD_HOR_SPAN,
+                  lv_area_get_width(area), lv_area_get_height(area));
+  return true;
+}
+
+
+static void LTDC_reload_event_callback(LTDC_HandleTypeDef *hltdc) {
+  // New front buffer is visible. Bring the back buffer up to date.
+  if(!lcd__sync_next())
+    lcd__flush_done();
+}
+#  endif
+
+
+// Called from DMA2D_IRQHandler()
+void lcd_dma2d_irq(void) {
+  if(LL_DMA2D_IsActiveFlag_TE(DMA2D))
+    LL_DMA2D_ClearFlag_TE(DMA2D);
+
+  if(LL_DMA2D_IsActiveFlag_TC(DMA2D))
+    LL_DMA2D_ClearFlag_TC(DMA2D);
+
+  LL_DMA2D_DisableIT_TC(DMA2D);
+  LL_DMA2D_DisableIT_TE(DMA2D);
+
+#  ifdef USE_DOUBLE_BUF
+  if(lcd__sync_next())  // Chain copies of remaining dirty areas
+    return;
+#  endif
+
+  lcd__flush_done();
+}
+
+
+// LVGL calls this repeatedly until the flush is done
+static void lcd_flush_wait(lv_disp_drv_t *disp_drv) {
+#if USE_GUI_PROFILE
+  uint32_t start = elapsed_mark();
+#endif
+
+  s_flush_waiter = xTaskGetCurrentTaskHandle();
+  if(disp_drv->draw_buf->flushing)
+    ulTaskNotifyTake(pdTRUE, 1);  // Timeout guards against a missed interrupt
+  s_flush_waiter = NULL;
+
+#if USE_GUI_PROFILE
+  gui_profile_flush_wait(start);
+#endif
+}
+
 
-  static_assert(LV_COLOR_DEPTH <= LCD_COLOR_DEPTH, "Color depth incompatible");
+static void lcd_flush(lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t *color_p) {
+#if USE_GUI_PROFILE
+  gui_profile_flush(disp_drv, area);
+#endif
 
 #ifdef USE_DOUBLE_BUF
+  // Direct mode: color_p is the whole frame buffer and areas are already rendered in place
+  if(!lv_disp_flush_is_last(disp_drv)) {
+    lv_disp_flush_ready(disp_drv);
+    return;
+  }
+
+  // Record this frame's dirty areas to sync into the other buffer after the swap
+  lv_disp_t *disp = _lv_refr_get_disp_refreshing();
+  s_sync_count = 0;
+  s_sync_next = 0;
+  for(uint16_t i = 0; i < disp->inv_p; i++) {
+    if(!disp->inv_area_joined[i])
+      s_sync_areas[s_sync_count++] = disp->inv_areas[i];
+  }
+
+  s_sync_front = (LCDPixel *)color_p;
+  s_sync_back = s_sync_front == framebuf_bg0 ? framebuf_bg1 : framebuf_bg0;
+  s_flush_disp = disp_drv;
+
   lcd_switch_buffer(color_p);
-  // lv_disp_flush_ready() called on reload interrupt
+  // lv_disp_flush_ready() called after the sync following the reload interrupt
 
 #else // Single full frame buffer
 
   lv_coord_t hres = disp_drv->hor_res;
   lv_coord_t vres = disp_drv->ver_res;
 
-  // Area must be within display
-  if(!(area->x2 < 0 || area->y2 < 0 || area->x1 > hres - 1 || area->y1 > vres - 1)) {
+  // Clip area to display
+  lv_coord_t x1 = LV_MAX(area->x1, 0);
+  lv_coord_t y1 = LV_MAX(area->y1, 0);
+  lv_coord_t x2 = LV_MIN(area->x2, hres - 1);
+  lv_coord_t y2 = LV_MIN(area->y2, vres - 1);
 
-    // Copy area into display buffer
-#  if LV_COLOR_DEPTH == 32 || LV_COLOR_DEPTH == 24 || LV_COLOR_DEPTH == LCD_COLOR_DEPTH
-    size_t w = lv_area_get_width(area);
-    // Copy entire lines
-    for(int32_t y = area->y1; y <= area->y2 && y < disp_drv->ver_res; y++) {
-      memcpy(&framebuf_bg0[y * hres + area->x1], color_p, w * sizeof(lv_color_t));
-      color_p += w;
-    }
-#  else // Mismatched color depths
-    // Copy individual pixels and expand them into 32-bits
-    for(int32_t y = area->y1; y <= area->y2 && y < disp_drv->ver_res; y++) {
-      for(int32_t x = area->x1; x <= area->x2; x++) {
-        framebuf_bg0[y * hres + x] = lv_color_to32(*color_p);
-        color_p++;
-      }
-    }
-#  endif
+  if(x1 > x2 || y1 > y2) {
+    lv_disp_flush_ready(disp_drv);
+    return;
   }
 
-lv_disp_flush_ready(disp_drv);
+  lv_coord_t src_w = lv_area_get_width(area);
+  const lv_color_t *src = color_p + (y1 - area->y1) * src_w + (x1 - area->x1);
+
+  s_flush_disp = disp_drv;
+  lcd__dma2d_copy(src, src_w, &framebuf_bg0[y1 * LCD_HOR_SPAN + x1], LCD_HOR_SPAN,
+                  x2 - x1 + 1, y2 - y1 + 1);
+  // lv_disp_flush_ready() called from DMA2D interrupt
 #endif // USE_DOUBLE_BUF
 
 }
@@ -203,6 +407,7 @@ lv_disp_flush_ready(disp_drv);
 static void touch_input_read(lv_indev_drv_t *drv, lv_indev_data_t *data) {
   data->point = g_touch_state.point;
   data->state = g_touch_state.pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+  input__pause_if_idle(drv, data);
 }
 
 
@@ -391,7 +596,11 @@ void touch_poll_task_cb(TimerHandle_t timer) {
     }
   }
 
+  bool changed = pressed != g_touch_state.pressed;
   g_touch_state.pressed = pressed;
+
+  if(changed)
+    input__wake();
 }
 
 
@@ -425,13 +634,15 @@ void lvgl_stm32_init(void) {
   lv_disp_drv_init(&s_disp_drv);
   s_disp_drv.draw_buf     = &disp_buf1;
   s_disp_drv.flush_cb     = lcd_flush;
+  s_disp_drv.monitor_cb   = gui_refr_monitor;
   s_disp_drv.hor_res      = LCD_HOR_RES;
   s_disp_drv.ver_res      = LCD_VER_RES;
   s_disp_drv.antialiasing = 1;
 //  s_disp_drv.rotated      = LV_DISP_ROT_270;
 //  s_disp_drv.sw_rotate    = 1;  // Does not work in full frame mode
+  s_disp_drv.wait_cb      = lcd_flush_wait;
 #ifdef USE_DOUBLE_BUF
-  s_disp_drv.full_refresh = 1;
+  s_disp_drv.direct_mode  = 1;  // Only redraw invalidated areas
 #endif
 
   g_disp_main = lv_disp_drv_register(&s_disp_drv);
@@ -484,6 +695,14 @@ void lvgl_stm32_init(void) {
 #endif // PLATFORM_EMBEDDED
 
 #ifndef PLATFORM_EMBEDDED
+static void sim_flush(lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t *color_p) {
+#if USE_GUI_PROFILE
+  gui_profile_flush(disp_drv, area);
+#endif
+  monitor_flush(disp_drv, area, color_p);
+}
+
+
 void lvgl_sim_init(void) {
   lv_init();
 
@@ -513,7 +732,8 @@ void lvgl_sim_init(void) {
 
   lv_disp_drv_init(&s_disp_drv);
   s_disp_drv.draw_buf     = &disp_buf1;
-  s_disp_drv.flush_cb     = monitor_flush;
+  s_disp_drv.flush_cb     = sim_flush;
+  s_disp_drv.monitor_cb   = gui_refr_monitor;
   s_disp_drv.hor_res      = LCD_HOR_RES;
   s_disp_drv.ver_res      = LCD_VER_RES;
   s_disp_drv.antialiasing = 1;
@@ -556,18 +776,93 @@ void lvgl_sim_init(void) {
   lv_indev_t *kb_indev = lv_indev_drv_register(&keyboard_drv);
   lv_indev_set_group(kb_indev, def_grp);
 }
-#endif // PLATFORM_EMBEDDED
 
-#ifdef USE_DOUBLE_BUF
-void LTDC_reload_event_callback(LTDC_HandleTypeDef *hltdc) {
-  // NOTE: Move this call to a deferred interrupt task if LV_COLOR_SCREEN_TRANSP is
-  // enabled. Otherwise a full frame memset is called in interrupt context.
-  lv_disp_flush_ready(&s_disp_drv);
-}
+
+// Headless display for benchmarks and golden image tests. Frames render into
+// a memory buffer with no window or input devices. The caller provides
+// gui_tick_ms() and drives lv_timer_handler().
+static lv_color_t s_headless_fb[LCD_HOR_RES * LCD_VER_RES];
+
+static void headless_flush(lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t *color_p) {
+#if USE_GUI_PROFILE
+  gui_profile_flush(disp_drv, area);
 #endif
 
+  int32_t w = lv_area_get_width(area);
+  for(int32_t y = area->y1; y <= area->y2; y++) {
+    memcpy(&s_headless_fb[y * LCD_HOR_RES + area->x1], color_p, w * sizeof(lv_color_t));
+    color_p += w;
+  }
+
+  lv_disp_flush_ready(disp_drv);
+}
+
+
+void lvgl_headless_init(void) {
+  lv_init();
+
+  static lv_disp_drv_t s_disp_drv;
+  static lv_disp_draw_buf_t disp_buf1;
+
+#  define HEADLESS_BUF_LINES  40
+  static lv_color_t buf1_1[LCD_HOR_RES * HEADLESS_BUF_LINES];
+  lv_disp_draw_buf_init(&disp_buf1, buf1_1, NULL, LCD_HOR_RES * HEADLESS_BUF_LINES);
+
+  lv_disp_drv_init(&s_disp_drv);
+  s_disp_drv.draw_buf     = &disp_buf1;
+  s_disp_drv.flush_cb     = headless_flush;
+  s_disp_drv.monitor_cb   = gui_refr_monitor;
+  s_disp_drv.hor_res      = LCD_HOR_RES;
+  s_disp_drv.ver_res      = LCD_VER_RES;
+  s_disp_drv.antialiasing = 1;
+
+  g_disp_main = lv_disp_drv_register(&s_disp_drv);
+
+  lv_group_t *def_grp = lv_group_create();
+  lv_group_set_default(def_grp);
+}
+
+
+// FNV-1a hash of the headless frame buffer
+uint32_t lvgl_headless_checksum(void) {
+  const uint8_t *data = (const uint8_t *)s_headless_fb;
+  uint32_t hash = 2166136261ul;
+
+  for(size_t i = 0; i < sizeof s_headless_fb; i++) {
+    hash = (hash ^ data[i]) * 16777619ul;
+  }
+
+  return hash;
+}
+#endif // PLATFORM_EMBEDDED
 
 #ifdef PLATFORM_EMBEDDED
+// Convert ARGB8888 BSP color to the frame buffer format
+static inline uint32_t lcd__color(uint32_t argb) {
+#  if LCD_COLOR_DEPTH == 16
+  return ((argb >> 8) & 0xF800) | ((argb >> 5) & 0x07E0) | ((argb >> 3) & 0x001F);
+#  else
+  return argb;
+#  endif
+}
+
+
+// Blocking DMA2D fill of a rectangle in the frame buffer format. The BSP fills
+// always write ARGB8888 so they can't be used on RGB565 layers.
+static void lcd__fill_rect(LCDPixel *fb, lv_coord_t x, lv_coord_t y, lv_coord_t w, lv_coord_t h,
+                           uint32_t argb) {
+  LL_DMA2D_SetMode(DMA2D, LL_DMA2D_MODE_R2M);
+  LL_DMA2D_SetOutputColorMode(DMA2D, DMA2D_OUTPUT_MODE);
+  LL_DMA2D_SetOutputColor(DMA2D, lcd__color(argb));
+  LL_DMA2D_SetOutputMemAddr(DMA2D, (uintptr_t)&fb[y * LCD_HOR_SPAN + x]);
+  LL_DMA2D_SetLineOffset(DMA2D, LCD_HOR_SPAN - w);
+  LL_DMA2D_ConfigSize(DMA2D, h, w);
+
+  LL_DMA2D_Start(DMA2D);
+  while(LL_DMA2D_IsTransferOngoing(DMA2D)) {}
+}
+
+
 void lcd_init(void) {
 //  printf("## LCD: %lux%lu\n", BSP_LCD_GetXSize(), BSP_LCD_GetYSize());
 
@@ -581,20 +876,17 @@ void lcd_init(void) {
 #  endif
 
   // Configure background layer
-  BSP_LCD_SelectLayer(LCD_BACKGROUND_LAYER);
-  BSP_LCD_Clear(LCD_COLOR_BLACK);
+  lcd__fill_rect(framebuf_bg0, 0, 0, LCD_HOR_RES, LCD_VER_RES, LCD_COLOR_BLACK);
 
   // Configure foreground layer
-  BSP_LCD_SelectLayer(LCD_FOREGROUND_LAYER);
-  BSP_LCD_Clear(LCD_COLOR_GREEN);
+  lcd__fill_rect(framebuf_fg, 0, 0, LCD_HOR_RES, LCD_VER_RES, LCD_COLOR_GREEN);
+  // LTDC compares the color key after expanding pixels to RGB888 by MSB replication.
+  // Pure green survives the round trip through RGB565 unchanged.
   BSP_LCD_SetColorKeying(LCD_FOREGROUND_LAYER, LCD_COLOR_GREEN);
   BSP_LCD_SetTransparency(LCD_FOREGROUND_LAYER, 50);
 
-  BSP_LCD_SetBackColor(LCD_COLOR_GREEN);
-
-  BSP_LCD_SetTextColor(LCD_COLOR_RED);
   // Add transparent overlay for screen portion that won't appear on GBA LCD (240x160)
-  BSP_LCD_FillRect(0,160, 240, 160);
+  lcd__fill_rect(framebuf_fg, 0, 160, 240, 160, LCD_COLOR_RED);
 
   //BSP_LCD_DisplayStringAt(20,20, (uint8_t *)"Hello!", LEFT_MODE);
 
@@ -607,10 +899,15 @@ void lcd_init(void) {
   // Setup touchscreen
   BSP_TS_Init(BSP_LCD_GetXSize(), BSP_LCD_GetYSize());
 
+  // Configure DMA2D for flushing draw buffers. Lower priority than audio DMA.
+  __HAL_RCC_DMA2D_CLK_ENABLE();
+  HAL_NVIC_SetPriority(DMA2D_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY+2, 0);
+  HAL_NVIC_EnableIRQ(DMA2D_IRQn);
+
 #  ifdef USE_DOUBLE_BUF
-  // Configure interrupt for LTDC reload
+  // Configure interrupt for LTDC reload. Callback may notify the LVGL task.
   HAL_LTDC_RegisterCallback(&LtdcHandler, HAL_LTDC_RELOAD_EVENT_CB_ID, LTDC_reload_event_callback);
-  HAL_NVIC_SetPriority(LTDC_IRQn, 2, 0);
+  HAL_NVIC_SetPriority(LTDC_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY+2, 0);
   HAL_NVIC_EnableIRQ(LTDC_IRQn);
 #  endif
 }
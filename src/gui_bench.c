@@ -0,0 +1,405 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lib_cfg/build_config.h"
+#include "lib_cfg/cstone_cfg_stm32.h"
+#include "cstone/platform.h"
+#include "app_main.h"
+#include "app_tasks.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cstone/prop_id.h"
+#include "app_prop_id.h"
+#include "cstone/prop_db.h"
+#include "cstone/umsg.h"
+#include "umsg_batch.h"
+#include "prop_snapshot.h"
+#include "util/mempool.h"
+#include "util/getopt_r.h"
+
+#include "lvgl/lvgl.h"
+#include "ui_panel.h"
+#include "ui_units.h"
+#include "app_ui.h"
+#if USE_GUI_PROFILE
+#  include "gui_profile.h"
+#endif
+#include "disco_ui.hpp"
+#include "app_prop_slots.h"
+#include "lib_cfg/lv_tick_src.h"
+
+/*
+Headless GUI benchmark
+
+Builds the instrument panel on a memory frame buffer and replays a scripted
+ride as ECU sensor prop updates. Each loop delivers changed props through the
+same batch handler and coalescer as the app, then advances the LVGL tick by one
+refresh period and renders. Time is simulated so animations and frame contents
+are identical on every run. The loop runs as fast as the host allows.
+
+The GUI profiler reports render and per-prop handler times. The checksum of
+the final frame can be compared against a known value for golden image tests.
+
+The prop DB has no message hub here. Props are written to the DB and snapshot
+directly and their messages passed to the GUI handlers.
+*/
+
+#define BENCH_FRAME_MS      LV_DISP_DEF_REFR_PERIOD
+#define BENCH_DEFAULT_LOOPS 3000
+#define FIXED_24_8          (1 << 8)
+
+PropDB        g_prop_db;
+mpPoolSet     g_pool_set;
+PropSnapshot  g_prop_snapshot;
+
+extern UIReactWidgets    g_react_widgets;
+extern UIWidgetRegistry  g_widget_reg;
+
+
+static const PropDefaultDef s_prop_defaults[] = {
+  PROP_SLOTS_APP(PROP_SLOT_DEFAULT_ITEM)
+  P_END_DEFAULTS
+};
+
+static const uint32_t s_prop_slot_ids[] = {
+  PROP_SLOTS_GUI(PROP_SLOT_ID_ITEM)
+};
+
+static PropSnapshotSlot s_prop_slots[PROP_SLOT_COUNT];
+
+
+static struct timespec s_boot_timestamp;
+
+uint32_t boot_time_us(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)((now.tv_sec - s_boot_timestamp.tv_sec) * 1000000l +
+                    (now.tv_nsec - s_boot_timestamp.tv_nsec) / 1000l);
+}
+
+uint32_t elapsed_mark(void) {
+  return boot_time_us();
+}
+
+uint32_t elapsed_us(uint32_t mark) {
+  return boot_time_us() - mark;
+}
+
+
+// Simulated LVGL time advanced by the benchmark loop
+static uint32_t s_bench_tick_ms = 0;
+
+uint32_t gui_tick_ms(void) {
+  return s_bench_tick_ms;
+}
+
+
+// Every loop renders so there is no task to wake
+void gui_task_wake(void) {
+}
+
+
+void fatal_error(void) {
+  puts("Fatal error");
+  exit(2);
+}
+
+
+// ******************** Ride script ********************
+
+typedef struct {
+  uint32_t  time_ms;
+  uint16_t  speed;    // km/h
+  uint16_t  rpm;
+  uint8_t   gear;
+  bool      stand;
+  int16_t   coolant;  // Celsius
+  uint8_t   fuel;     // %
+  uint8_t   volts_x10;
+} BenchKeyframe;
+
+// Values are interpolated between keyframes. Gear and side stand hold.
+static const BenchKeyframe s_ride[] = {
+  // ms     km/h  rpm  gear stand   C  fuel  V
+  {     0,    0, 1100, 0, true,   40,  80, 124},
+  {  1500,    0, 1100, 1, false,  42,  80, 138},
+  {  4000,   40, 9000, 1, false,  48,  80, 139},
+  {  4300,   40, 6000, 2, false,  48,  79, 139},
+  {  7000,   80, 9500, 2, false,  55,  79, 140},
+  {  7300,   80, 7000, 3, false,  56,  79, 140},
+  { 10000,  120, 9000, 3, false,  65,  78, 141},
+  { 10300,  120, 7200, 4, false,  66,  78, 141},
+  { 14000,  150, 8000, 4, false,  80,  77, 142},
+  { 20000,  150, 8000, 4, false,  90,  76, 142},
+  { 24000,   60, 3500, 4, false,  92,  76, 140},
+  { 25000,   60, 5000, 2, false,  92,  76, 140},
+  { 28000,    0, 1100, 0, true,   88,  75, 136}
+};
+
+#define RIDE_MS   (s_ride[COUNT_OF(s_ride)-1].time_ms)
+
+
+static int32_t bench__lerp(int32_t a, int32_t b, uint32_t num, uint32_t den) {
+  return a + (b - a) * (int32_t)num / (int32_t)den;
+}
+
+
+typedef struct {
+  uint32_t  speed;      // 24.8 fixed point
+  uint32_t  rpm;
+  uint32_t  gear;
+  uint32_t  stand;
+  int32_t   coolant;
+  uint32_t  fuel;
+  uint32_t  voltage;    // 24.8 fixed point
+} BenchSensors;
+
+static void bench__ride_sample(uint32_t ride_ms, BenchSensors *s) {
+  ride_ms %= RIDE_MS;
+
+  unsigned k = 0;
+  while(s_ride[k+1].time_ms <= ride_ms)
+    k++;
+
+  const BenchKeyframe *k0 = &s_ride[k];
+  const BenchKeyframe *k1 = &s_ride[k+1];
+  uint32_t num = ride_ms - k0->time_ms;
+  uint32_t den = k1->time_ms - k0->time_ms;
+
+  s->speed    = bench__lerp(k0->speed * FIXED_24_8, k1->speed * FIXED_24_8, num, den);
+  s->rpm      = bench__lerp(k0->rpm, k1->rpm, num, den);
+  s->gear     = k0->gear;
+  s->stand    = k0->stand;
+  s->coolant  = bench__lerp(k0->coolant, k1->coolant, num, den);
+  s->fuel     = bench__lerp(k0->fuel, k1->fuel, num, den);
+  s->voltage  = bench__lerp(k0->volts_x10 * FIXED_24_8, k1->volts_x10 * FIXED_24_8, num, den) / 10;
+}
+
+
+// ******************** Prop delivery ********************
+
+#define BENCH_MAX_MSGS  16
+
+typedef struct {
+  UMsg      msgs[BENCH_MAX_MSGS];
+  unsigned  count;
+  uint32_t  total;  // Messages sent over the run
+} BenchBatch;
+
+
+// Update a sensor prop and queue its message if the value changed
+static void bench__set(BenchBatch *batch, uint32_t prop, uint32_t value) {
+  int slot = prop_slot(prop);
+  if(slot >= 0 && prop_snapshot_read_slot(&g_prop_snapshot, slot) == value)
+    return;
+
+  prop_set_uint(&g_prop_db, prop, value, P_RSRC_HW_LOCAL_TASK);
+  if(slot >= 0)
+    prop_snapshot_set_slot(&g_prop_snapshot, slot, value);
+
+  if(batch->count < BENCH_MAX_MSGS) {
+    batch->msgs[batch->count++] = (UMsg){ .id = prop, .source = P_RSRC_HW_LOCAL_TASK,
+                                          .payload = value };
+    batch->total++;
+  }
+}
+
+
+// ******************** Setup ********************
+
+static void bench__pools_init(void) {
+  alignas(mpPool)
+  static uint8_t s_mem_pool_large[POOL_SIZE_LG * POOL_COUNT_LG + MP_STATIC_PADDING(alignof(uintptr_t))];
+
+  alignas(mpPool)
+  static uint8_t s_mem_pool_med[POOL_SIZE_MD * POOL_COUNT_MD + MP_STATIC_PADDING(alignof(uintptr_t))];
+
+  alignas(mpPool)
+  static uint8_t s_mem_pool_small[POOL_SIZE_SM * POOL_COUNT_SM + MP_STATIC_PADDING(alignof(uintptr_t))];
+
+  mp_init_pool_set(&g_pool_set);
+  mpPool *pool;
+  pool = mp_create_static_pool((uint8_t *)s_mem_pool_large, sizeof s_mem_pool_large,
+                              POOL_SIZE_LG, alignof(uintptr_t));
+  mp_add_pool(&g_pool_set, pool);
+
+  pool = mp_create_static_pool((uint8_t *)s_mem_pool_med, sizeof s_mem_pool_med,
+                              POOL_SIZE_MD, alignof(uintptr_t));
+  mp_add_pool(&g_pool_set, pool);
+
+  pool = mp_create_static_pool((uint8_t *)s_mem_pool_small, sizeof s_mem_pool_small,
+                              POOL_SIZE_SM, alignof(uintptr_t));
+  mp_add_pool(&g_pool_set, pool);
+}
+
+
+// Same GUI setup as app_main.c on the headless display
+static void bench__gui_init(bool dark_mode) {
+  lvgl_headless_init();
+
+  ui_widget_reg_init(&g_widget_reg);
+  ui_widget_reg_add_defaults(&g_widget_reg);
+
+  ui_react_widgets_init(&g_react_widgets);
+
+  g_panels.instr.screen  = lv_scr_act();
+  g_panels.splash.screen = lv_obj_create(NULL);
+  g_panels.ts_cal.screen = lv_obj_create(NULL);
+  ui_panel_push(&g_panels.instr);
+
+  app_styles_init();
+  app_screens_init();
+
+  lv_theme_t *th = set_theme_mode(g_disp_main, /*dark_mode*/false);
+  lv_disp_set_theme(g_disp_main, th);
+
+  if(dark_mode) {
+    prop_set_uint(&g_prop_db, P_APP_GUI_INFO__DARK, 1, 0);
+    prop_snapshot_set_slot(&g_prop_snapshot, prop_slot(P_APP_GUI_INFO__DARK), 1);
+  }
+
+  gui_prop_init();
+}
+
+
+// ******************** Benchmark ********************
+
+static void usage(void) {
+  puts("catalyst_guibench [-n <loops>] [-d] [-c] [-g <checksum>] [-h]");
+  puts("  Replay a scripted ride on a headless display and report GUI times.");
+  printf("  -n sets the number of %d ms frame loops (default %d).\n", BENCH_FRAME_MS,
+         BENCH_DEFAULT_LOOPS);
+  puts("  -d uses the dark theme.");
+  puts("  -c prints the final frame checksum.");
+  puts("  -g fails if the final frame checksum differs.");
+}
+
+
+int main(int argc, char *argv[]) {
+  clock_gettime(CLOCK_MONOTONIC, &s_boot_timestamp);
+
+  uint32_t loops = BENCH_DEFAULT_LOOPS;
+  bool dark_mode = false;
+  bool show_checksum = false;
+  bool check_golden = false;
+  uint32_t golden = 0;
+
+  GetoptState state = {0};
+  state.report_errors = true;
+  int c;
+
+  while((c = getopt_r(argv, "n:dcg:h", &state)) != -1) {
+    switch(c) {
+    case 'n': loops = strtoul(state.optarg, NULL, 0); break;
+    case 'd': dark_mode = true; break;
+    case 'c': show_checksum = true; break;
+    case 'g': golden = strtoul(state.optarg, NULL, 16); check_golden = true; break;
+    case 'h': usage(); return 0; break;
+    default:
+    case ':':
+    case '?':
+      usage();
+      return 2;
+      break;
+    }
+  }
+
+  bench__pools_init();
+
+  prop_db_init(&g_prop_db, 32, 0, &g_pool_set);
+  prop_db_set_defaults(&g_prop_db, s_prop_defaults);
+
+  prop_snapshot_init(&g_prop_snapshot, s_prop_slot_ids, s_prop_slots, PROP_SLOT_COUNT,
+                     prop_slot, &g_prop_db, /*hub*/NULL);
+
+  bench__gui_init(dark_mode);
+
+  // Settle startup animations before measuring
+  for(unsigned i = 0; i < 1000 / BENCH_FRAME_MS; i++) {
+    s_bench_tick_ms += BENCH_FRAME_MS;
+    lv_timer_handler();
+  }
+#if USE_GUI_PROFILE
+  gui_profile_reset();
+  gui_profile_render(elapsed_mark()); // Apply reset
+#endif
+
+  BenchBatch batch = {0};
+  uint64_t speed_sum = 0;
+  uint32_t speed_max = 0;
+
+  uint32_t bench_start = elapsed_mark();
+
+  for(uint32_t i = 0; i < loops; i++) {
+    BenchSensors s;
+    bench__ride_sample(i * BENCH_FRAME_MS, &s);
+
+    speed_sum += s.speed;
+    if(s.speed > speed_max)
+      speed_max = s.speed;
+
+    batch.count = 0;
+    bench__set(&batch, P_SENSOR_ECU__SPEED__MAX,      speed_max); // Before value so GUI won't set it
+    bench__set(&batch, P_SENSOR_ECU__SPEED__VALUE,    s.speed);
+    bench__set(&batch, P_SENSOR_ECU__SPEED__AVERAGE,  speed_sum / (i+1));
+    bench__set(&batch, P_SENSOR_ECU__RPM__VALUE,      s.rpm);
+    bench__set(&batch, P_SENSOR_ECU__GEAR__VALUE,     s.gear);
+    bench__set(&batch, P_SENSOR_ECU__SIDESTAND__VALUE, s.stand);
+    bench__set(&batch, P_SENSOR_ECU__COOLANT_TEMP__VALUE, (uint32_t)s.coolant);
+    bench__set(&batch, P_SENSOR_ECU__FUEL__VALUE,     s.fuel);
+    bench__set(&batch, P_SENSOR_ECU__VOLTAGE__VALUE,  s.voltage);
+
+    gui_prop_batch_handler(NULL, batch.msgs, batch.count);
+
+    // Same sequence as the LVGL task
+    gui_prop_drain();
+
+    s_bench_tick_ms += BENCH_FRAME_MS;
+#if USE_GUI_PROFILE
+    uint32_t start = elapsed_mark();
+    lv_timer_handler();
+    gui_profile_render(start);
+#else
+    lv_timer_handler();
+#endif
+  }
+
+  uint32_t bench_us = elapsed_us(bench_start);
+
+  printf("Color depth: %d-bit\n", LCD_COLOR_DEPTH);
+  printf("Tacho:   %s\n", gui_tacho_sprites_active() ? "sprites" : "widgets");
+  printf("Loops:   %" PRIu32 " (%" PRIu32 " ms simulated)\n", loops, loops * BENCH_FRAME_MS);
+  printf("Props:   %" PRIu32 " updates\n", batch.total);
+  printf("Elapsed: %" PRIu32 " us\n", bench_us);
+  if(bench_us > 0)
+    printf("Rate:    %" PRIu32 " loops/s\n", (uint32_t)((uint64_t)loops * 1000000ull / bench_us));
+
+#if USE_GUI_PROFILE
+  GuiProfile prof;
+  gui_profile_get(&prof);
+  if(bench_us > 0)
+    printf("Frames:  %" PRIu32 "/s\n", (uint32_t)((uint64_t)prof.frames * 1000000ull / bench_us));
+
+  gui_profile_report();
+#else
+  puts("Build with USE_GUI_PROFILE for the render profile");
+#endif
+
+  uint32_t checksum = lvgl_headless_checksum();
+  if(show_checksum || check_golden)
+    printf("Checksum: %08" PRIX32 "\n", checksum);
+
+  if(check_golden && checksum != golden) {
+    printf("Frame mismatch: expected %08" PRIX32 "\n", golden);
+    return 1;
+  }
+
+  return 0;
+}
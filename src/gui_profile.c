@@ -0,0 +1,234 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lib_cfg/build_config.h"
+#include "app_main.h"
+
+#include "cstone/prop_id.h"
+#include "app_prop_id.h"
+#include "cstone/prop_db.h"
+#include "cstone/umsg.h"
+
+#include "lvgl/lvgl.h"
+#include "ui_panel.h"
+#include "app_ui.h"
+#include "gui_profile.h"
+
+/*
+GUI profiler
+
+Hooks around lv_timer_handler(), the display flush and monitor callbacks, and
+the prop message handler record where GUI time goes. They are only built with
+USE_GUI_PROFILE. Totals accumulate until reset and can be printed with the
+"frame" command. Once per publish interval the LVGL task
+computes averages over the interval. It writes them to the P_APP_GUI_PROFILE
+props and, when enabled, to an overlay on the top layer. The hosted build
+uses the same hooks, so UI changes can be profiled on a PC.
+
+All hooks run in the LVGL task. Console readers copy the totals without a
+lock so a report can mix counts from two frames, and table bounds are clamped
+on every use.
+*/
+
+static GuiProfile s_prof;
+static GuiProfile s_prof_prev;  // Totals at last publish
+
+static volatile bool s_prof_reset = false;
+static volatile bool s_overlay_show = false;
+static lv_obj_t *s_overlay = NULL;
+static uint32_t s_publish_start;  // elapsed_mark() at start of publish interval
+
+
+void gui_profile_flush(lv_disp_drv_t *disp_drv, const lv_area_t *area) {
+  s_prof.flush_px += lv_area_get_size(area);
+
+  if(lv_disp_flush_is_last(disp_drv)) {
+    s_prof.frames++;
+
+    // Invalidated areas are cleared before the monitor callback so count them here
+    lv_disp_t *disp = _lv_refr_get_disp_refreshing();
+    for(uint16_t i = 0; i < disp->inv_p; i++) {
+      if(!disp->inv_area_joined[i])
+        s_prof.flush_areas++;
+    }
+  }
+}
+
+
+void gui_profile_refr(uint32_t time_ms) {
+  s_prof.refr_total_ms += time_ms;
+  if(time_ms > s_prof.refr_max_ms)
+    s_prof.refr_max_ms = time_ms;
+}
+
+
+void gui_profile_flush_wait(uint32_t start) {
+  s_prof.flush_wait_us += elapsed_us(start);
+}
+
+
+void gui_profile_handler(uint32_t prop, uint32_t start) {
+  uint32_t elapsed = elapsed_us(start);
+  s_prof.handler_total_us += elapsed;
+
+  GuiPropProfile *pp = NULL;
+  uint16_t prop_count = LV_MIN(s_prof.prop_count, GUI_PROF_MAX_PROPS);
+  for(uint16_t i = 0; i < prop_count; i++) {
+    if(s_prof.props[i].prop == prop) {
+      pp = &s_prof.props[i];
+      break;
+    }
+  }
+
+  if(!pp) {
+    if(prop_count >= GUI_PROF_MAX_PROPS) {
+      s_prof.untracked++;
+      return;
+    }
+
+    pp = &s_prof.props[prop_count];
+    s_prof.prop_count = prop_count + 1;
+    memset(pp, 0, sizeof(*pp));
+    pp->prop = prop;
+  }
+
+  pp->calls++;
+  pp->total_us += elapsed;
+  if(elapsed > pp->max_us)
+    pp->max_us = elapsed;
+}
+
+
+// ******************** Publishing ********************
+
+static void gui_profile__update_overlay(const char *text) {
+  if(s_overlay_show && !s_overlay) {
+    s_overlay = lv_label_create(lv_layer_top());
+    lv_obj_set_style_bg_color(s_overlay, lv_color_black(), LV_PART_MAIN);
+    lv_obj_set_style_bg_opa(s_overlay, LV_OPA_60, LV_PART_MAIN);
+    lv_obj_set_style_text_color(s_overlay, lv_color_white(), LV_PART_MAIN);
+    lv_obj_set_style_pad_all(s_overlay, 2, LV_PART_MAIN);
+    lv_obj_align(s_overlay, LV_ALIGN_BOTTOM_LEFT, 0, 0);
+
+  } else if(!s_overlay_show && s_overlay) {
+    lv_obj_del(s_overlay);
+    s_overlay = NULL;
+  }
+
+  if(s_overlay && text)
+    lv_label_set_text(s_overlay, text);
+}
+
+
+static void gui_profile__publish(uint32_t interval_us) {
+  uint32_t loops  = s_prof.loops - s_prof_prev.loops;
+  uint32_t frames = s_prof.frames - s_prof_prev.frames;
+
+  uint32_t render_us  = loops > 0 ? (s_prof.render_total_us - s_prof_prev.render_total_us) / loops : 0;
+  uint32_t px         = frames > 0 ? (s_prof.flush_px - s_prof_prev.flush_px) / frames : 0;
+  uint32_t areas      = frames > 0 ? (s_prof.flush_areas - s_prof_prev.flush_areas) / frames : 0;
+  uint32_t handler_us = s_prof.handler_total_us - s_prof_prev.handler_total_us;
+  uint32_t fps        = (uint64_t)frames * 1000000ull / interval_us;
+
+  s_prof_prev = s_prof;
+
+  prop_set_uint(&g_prop_db, P_APP_GUI_PROFILE__RENDER,  render_us,  P_RSRC_GUI_LOCAL_WIDGET);
+  prop_set_uint(&g_prop_db, P_APP_GUI_PROFILE__PIXELS,  px,         P_RSRC_GUI_LOCAL_WIDGET);
+  prop_set_uint(&g_prop_db, P_APP_GUI_PROFILE__AREAS,   areas,      P_RSRC_GUI_LOCAL_WIDGET);
+  prop_set_uint(&g_prop_db, P_APP_GUI_PROFILE__HANDLER, handler_us, P_RSRC_GUI_LOCAL_WIDGET);
+  prop_set_uint(&g_prop_db, P_APP_GUI_PROFILE__FPS,     fps,        P_RSRC_GUI_LOCAL_WIDGET);
+
+  if(s_overlay_show || s_overlay) {
+    char buf[64];
+    snprintf(buf, sizeof buf, "%2" PRIu32 " fps  %5" PRIu32 " us\n%5" PRIu32 " px  %2" PRIu32
+             " areas\nhandlers %5" PRIu32 " us/s", fps, render_us, px, areas, handler_us);
+    gui_profile__update_overlay(buf);
+  }
+}
+
+
+// Called from the LVGL task after lv_timer_handler()
+void gui_profile_render(uint32_t start) {
+  uint32_t now = elapsed_mark();
+
+  if(s_prof_reset) {
+    s_prof_reset = false;
+    memset(&s_prof, 0, sizeof s_prof);
+    memset(&s_prof_prev, 0, sizeof s_prof_prev);
+    s_publish_start = now;
+    return;
+  }
+
+  uint32_t elapsed = elapsed_us(start);
+  s_prof.loops++;
+  s_prof.render_total_us += elapsed;
+  if(elapsed > s_prof.render_max_us)
+    s_prof.render_max_us = elapsed;
+
+  uint32_t interval_us = elapsed_us(s_publish_start);
+  if(interval_us >= GUI_PROF_PUBLISH_MS * 1000ul) {
+    s_publish_start = now;
+    gui_profile__publish(interval_us);
+  }
+}
+
+
+// ******************** Control ********************
+
+void gui_profile_reset(void) {
+  s_prof_reset = true;
+}
+
+
+// Overlay is created or removed by the LVGL task at the next publish
+void gui_profile_show_overlay(bool show) {
+  s_overlay_show = show;
+}
+
+
+bool gui_profile_overlay_shown(void) {
+  return s_overlay_show;
+}
+
+
+void gui_profile_get(GuiProfile *prof) {
+  *prof = s_prof;
+}
+
+
+void gui_profile_report(void) {
+  GuiProfile prof;
+  gui_profile_get(&prof);
+
+  if(prof.loops > 0) {
+    printf("Render:  %" PRIu32 " us avg, %" PRIu32 " us max (%" PRIu32 " loops)\n",
+           prof.render_total_us / prof.loops, prof.render_max_us, prof.loops);
+  }
+
+  if(prof.frames > 0) {
+    printf("Frame:   %" PRIu32 " ms avg, %" PRIu32 " ms max (%" PRIu32 " frames)\n",
+           prof.refr_total_ms / prof.frames, prof.refr_max_ms, prof.frames);
+    printf("Flush:   %" PRIu32 " px, %" PRIu32 ".%02" PRIu32 " areas, %" PRIu32 " us wait / frame\n",
+           prof.flush_px / prof.frames,
+           prof.flush_areas / prof.frames, (prof.flush_areas * 100 / prof.frames) % 100,
+           prof.flush_wait_us / prof.frames);
+  }
+
+  printf("Handlers: %" PRIu32 " us total\n", prof.handler_total_us);
+  uint16_t prop_count = LV_MIN(prof.prop_count, GUI_PROF_MAX_PROPS);
+  if(prop_count == 0)
+    return;
+
+  puts("  Prop       Calls   Avg us  Max us");
+  for(uint16_t i = 0; i < prop_count; i++) {
+    GuiPropProfile *pp = &prof.props[i];
+    printf("  %08" PRIX32 " %7" PRIu32 " %8" PRIu32 " %7" PRIu32 "\n", pp->prop, pp->calls,
+           pp->calls > 0 ? pp->total_us / pp->calls : 0, pp->max_us);
+  }
+
+  if(prof.untracked > 0)
+    printf("  (%" PRIu32 " calls for untracked props)\n", prof.untracked);
+}
@@ -0,0 +1,139 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "heatshrink_encoder.h"
+#include "heatshrink_decoder.h"
+
+#include "log_compress.h"
+
+/*
+Log record compression
+
+Record payloads are compressed with heatshrink before they are written to a
+log and expanded with the streaming decoder when read back. Both directions
+work on caller supplied buffers. A failure to fit the output is reported so
+the caller can store the record uncompressed instead.
+
+The codec state is shared and is only used from one task at a time.
+*/
+
+#define DECODER_INPUT_SIZE  64
+
+
+#if HEATSHRINK_DYNAMIC_ALLOC
+static heatshrink_encoder *s_encoder = NULL;
+static heatshrink_decoder *s_decoder = NULL;
+
+static heatshrink_encoder *log_compress__encoder(void) {
+  if(!s_encoder)
+    s_encoder = heatshrink_encoder_alloc(LOG_COMPRESS_WINDOW_SZ2, LOG_COMPRESS_LOOKAHEAD_SZ2);
+  else
+    heatshrink_encoder_reset(s_encoder);
+  return s_encoder;
+}
+
+static heatshrink_decoder *log_compress__decoder(void) {
+  if(!s_decoder)
+    s_decoder = heatshrink_decoder_alloc(DECODER_INPUT_SIZE, LOG_COMPRESS_WINDOW_SZ2,
+                                         LOG_COMPRESS_LOOKAHEAD_SZ2);
+  else
+    heatshrink_decoder_reset(s_decoder);
+  return s_decoder;
+}
+
+#else // Static allocation uses parameters from heatshrink_config.h
+#  if HEATSHRINK_STATIC_WINDOW_BITS != LOG_COMPRESS_WINDOW_SZ2 || \
+      HEATSHRINK_STATIC_LOOKAHEAD_BITS != LOG_COMPRESS_LOOKAHEAD_SZ2
+#    error "heatshrink_config.h static parameters must match LOG_COMPRESS_*"
+#  endif
+
+static heatshrink_encoder s_encoder;
+static heatshrink_decoder s_decoder;
+
+static heatshrink_encoder *log_compress__encoder(void) {
+  heatshrink_encoder_reset(&s_encoder);
+  return &s_encoder;
+}
+
+static heatshrink_decoder *log_compress__decoder(void) {
+  heatshrink_decoder_reset(&s_decoder);
+  return &s_decoder;
+}
+#endif
+
+
+// Compress a record into dest. Returns compressed size or -1 if it doesn't fit
+ptrdiff_t log_compress(const uint8_t *src, size_t src_len, uint8_t *dest, size_t dest_size) {
+  heatshrink_encoder *hse = log_compress__encoder();
+  if(!hse)
+    return -1;
+
+  size_t out_len = 0;
+  size_t count;
+
+  while(src_len > 0) {
+    if(heatshrink_encoder_sink(hse, (uint8_t *)src, src_len, &count) < 0)
+      return -1;
+    src += count;
+    src_len -= count;
+
+    HSE_poll_res pres;
+    do {
+      pres = heatshrink_encoder_poll(hse, &dest[out_len], dest_size - out_len, &count);
+      if(pres < 0)
+        return -1;
+      out_len += count;
+      if(pres == HSER_POLL_MORE && out_len >= dest_size)
+        return -1;
+    } while(pres == HSER_POLL_MORE);
+  }
+
+  while(heatshrink_encoder_finish(hse) == HSER_FINISH_MORE) {
+    if(out_len >= dest_size)
+      return -1;
+    if(heatshrink_encoder_poll(hse, &dest[out_len], dest_size - out_len, &count) < 0)
+      return -1;
+    out_len += count;
+  }
+
+  return out_len;
+}
+
+
+// Expand a compressed record into dest. Returns expanded size or -1 if it doesn't fit
+ptrdiff_t log_decompress(const uint8_t *src, size_t src_len, uint8_t *dest, size_t dest_size) {
+  heatshrink_decoder *hsd = log_compress__decoder();
+  if(!hsd)
+    return -1;
+
+  size_t out_len = 0;
+  size_t count;
+
+  while(src_len > 0) {
+    if(heatshrink_decoder_sink(hsd, (uint8_t *)src, src_len, &count) < 0)
+      return -1;
+    src += count;
+    src_len -= count;
+
+    HSD_poll_res pres;
+    do {
+      pres = heatshrink_decoder_poll(hsd, &dest[out_len], dest_size - out_len, &count);
+      if(pres < 0)
+        return -1;
+      out_len += count;
+      if(pres == HSDR_POLL_MORE && out_len >= dest_size)
+        return -1;
+    } while(pres == HSDR_POLL_MORE);
+  }
+
+  while(heatshrink_decoder_finish(hsd) == HSDR_FINISH_MORE) {
+    if(out_len >= dest_size)
+      return -1;
+    if(heatshrink_decoder_poll(hsd, &dest[out_len], dest_size - out_len, &count) < 0)
+      return -1;
+    out_len += count;
+  }
+
+  return out_len;
+}
@@ -2,67 +2,248 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "FreeRTOS.h"
+#include "semphr.h"
+
 #include "cstone/log_db.h"
 #include "cstone/log_info.h"
-#include "log_evfs.h"
 
 #include "util/minmax.h"
 
 #include "evfs.h"
+#include "log_evfs.h"
 
-// ******************** Log DB EVFS callbacks ********************
+/*
+Log DB EVFS backend
 
+Blocks are accessed through a single page cache. Writes modify the cached
+page and only reach the file when a different page is loaded or the log is
+synced. The file is only synced after a sector erase or an explicit call to
+log_evfs_sync() at the end of a transaction, rather than after every block.
+Every LogDB writer must end its transaction with log_evfs_sync().
 
-void log_evfs_erase_sector(void *ctx, size_t sector_start, size_t sector_size) {
-  EvfsFile *fh = (EvfsFile *)ctx;
+The cache is shared by all LogDB callers so each entry point holds a mutex.
 
-  if(evfs_file_seek(fh, (evfs_off_t)sector_start, EVFS_SEEK_TO) != EVFS_OK)
-    return;
+A file shorter than the log is grown at init with erased data. If the file
+can't be opened or grown, the context is still usable but every access fails.
+*/
+
+#define PAGE_MASK   (~((size_t)LOG_EVFS_PAGE_SIZE-1))
 
-  uint8_t buf[64];
-  size_t write_bytes;
+static const uint8_t s_erased[LOG_EVFS_PAGE_SIZE] = {
+  [0 ... LOG_EVFS_PAGE_SIZE-1] = 0xFF
+};
 
-  memset(buf, 0xFF, sizeof(buf));
 
-  while(sector_size > 0) {
-    write_bytes = min(sizeof(buf), sector_size);
-    write_bytes = evfs_file_write(fh, buf, write_bytes);
+// Write erased data from the current file position up to end
+static bool log_evfs__fill_erased(EvfsFile *fh, size_t start, size_t end) {
+  while(start < end) {
+    size_t chunk = min(sizeof(s_erased), end - start);
+    ptrdiff_t write_bytes = evfs_file_write(fh, s_erased, chunk);
     if(write_bytes <= 0)
-      break;
-    sector_size -= write_bytes;
+      return false;
+    start += write_bytes;
   }
 
-  evfs_file_sync(fh);
+  return true;
 }
 
 
-bool log_evfs_read_block(void *ctx, size_t block_start, uint8_t *dest, size_t block_size) {
-  EvfsFile *fh = (EvfsFile *)ctx;
+// Prepare a context for a log of log_size bytes. Returns false if fh is NULL
+// or the file can't be grown to fit the log.
+bool log_evfs_init(LogEvfs *le, EvfsFile *fh, size_t log_size) {
+  memset(le, 0, sizeof(*le));
+  le->fh = fh;
+  le->lock = xSemaphoreCreateMutexStatic(&le->lock_buf);
 
-  if(evfs_file_seek(fh, (evfs_off_t)block_start, EVFS_SEEK_TO) != EVFS_OK)
+  if(!fh)
     return false;
 
-  ptrdiff_t read_bytes = evfs_file_read(fh, dest, block_size);
-  if(read_bytes <= 0)
+  evfs_off_t cur_size = evfs_file_size(fh);
+  if(cur_size < 0)
     return false;
 
+  if((size_t)cur_size < log_size) {
+    if(evfs_file_seek(fh, cur_size, EVFS_SEEK_TO) != EVFS_OK ||
+       !log_evfs__fill_erased(fh, cur_size, log_size) ||
+       evfs_file_sync(fh) != EVFS_OK)
+      return false;
+  }
+
+  le->file_size = log_size;
   return true;
 }
 
 
-bool log_evfs_write_block(void *ctx, size_t block_start, uint8_t *src, size_t block_size) {
-  EvfsFile *fh = (EvfsFile *)ctx;
+// Caller must hold the lock for all internal functions
 
-  if(evfs_file_seek(fh, (evfs_off_t)block_start, EVFS_SEEK_TO) != EVFS_OK)
-    return false;
+// Length of the page at page_start that lies within the log
+static inline size_t log_evfs__page_len(LogEvfs *le, size_t page_start) {
+  if(page_start >= le->file_size)
+    return 0;
+
+  return min(LOG_EVFS_PAGE_SIZE, le->file_size - page_start);
+}
+
+
+static bool log_evfs__write_back(LogEvfs *le) {
+  if(!le->page_dirty)
+    return true;
 
-  ptrdiff_t write_bytes = evfs_file_write(fh, src, block_size);
-  if(write_bytes <= 0)
+  size_t page_len = log_evfs__page_len(le, le->page_start);
+  if(page_len > 0) {
+    if(evfs_file_seek(le->fh, (evfs_off_t)le->page_start, EVFS_SEEK_TO) != EVFS_OK)
+      return false;
+
+    ptrdiff_t write_bytes = evfs_file_write(le->fh, le->page, page_len);
+    if(write_bytes <= 0)
+      return false;
+  }
+
+  le->page_dirty = false;
+  return true;
+}
+
+
+static bool log_evfs__load_page(LogEvfs *le, size_t offset) {
+  size_t page_start = offset & PAGE_MASK;
+
+  if(le->page_valid && le->page_start == page_start)
+    return true;
+
+  if(!log_evfs__write_back(le))
     return false;
 
-  evfs_file_sync(fh);
+  le->page_valid = false;
+  ptrdiff_t read_bytes = 0;
+  size_t page_len = log_evfs__page_len(le, page_start);
+  if(page_len > 0) {
+    if(evfs_file_seek(le->fh, (evfs_off_t)page_start, EVFS_SEEK_TO) != EVFS_OK)
+      return false;
+
+    read_bytes = evfs_file_read(le->fh, le->page, page_len);
+    if(read_bytes < 0)
+      return false;
+  }
+
+  // Anything past the end of file reads as erased
+  memset(&le->page[read_bytes], 0xFF, LOG_EVFS_PAGE_SIZE - read_bytes);
+
+  le->page_start = page_start;
+  le->page_valid = true;
   return true;
 }
 
 
+static bool log_evfs__sync(LogEvfs *le) {
+  if(!le->fh)
+    return false;
+
+  bool status = log_evfs__write_back(le);
+
+  // Sync even when write back fails so earlier writes are still committed
+  return (evfs_file_sync(le->fh) == EVFS_OK) && status;
+}
+
+
+// Commit buffered writes to the file. Call at the end of each log transaction.
+bool log_evfs_sync(void *ctx) {
+  LogEvfs *le = (LogEvfs *)ctx;
+
+  xSemaphoreTake(le->lock, portMAX_DELAY);
+  bool status = log_evfs__sync(le);
+  xSemaphoreGive(le->lock);
+
+  return status;
+}
+
+
+// ******************** Log DB EVFS callbacks ********************
+
+
+void log_evfs_erase_sector(void *ctx, size_t sector_start, size_t sector_size) {
+  LogEvfs *le = (LogEvfs *)ctx;
+
+  if(sector_start >= le->file_size)
+    return;
+  sector_size = min(sector_size, le->file_size - sector_start);
+
+  xSemaphoreTake(le->lock, portMAX_DELAY);
+
+  // Keep cached page coherent with the erased range
+  if(le->page_valid) {
+    size_t page_end = le->page_start + LOG_EVFS_PAGE_SIZE;
+    size_t sector_end = sector_start + sector_size;
+    if(sector_start < page_end && sector_end > le->page_start) {
+      size_t erase_start = max(sector_start, le->page_start);
+      size_t erase_end = min(sector_end, page_end);
+      memset(&le->page[erase_start - le->page_start], 0xFF, erase_end - erase_start);
+    }
+  }
+
+  if(evfs_file_seek(le->fh, (evfs_off_t)sector_start, EVFS_SEEK_TO) == EVFS_OK)
+    log_evfs__fill_erased(le->fh, sector_start, sector_start + sector_size);
+
+  // Erase is a transaction boundary
+  log_evfs__sync(le);
+  xSemaphoreGive(le->lock);
+}
+
+
+bool log_evfs_read_block(void *ctx, size_t block_start, uint8_t *dest, size_t block_size) {
+  LogEvfs *le = (LogEvfs *)ctx;
+
+  if(block_start > le->file_size || block_size > le->file_size - block_start)
+    return false;
+
+  bool status = true;
+  xSemaphoreTake(le->lock, portMAX_DELAY);
 
+  while(block_size > 0) {
+    if(!log_evfs__load_page(le, block_start)) {
+      status = false;
+      break;
+    }
+
+    size_t page_offset = block_start - le->page_start;
+    size_t chunk = min(block_size, LOG_EVFS_PAGE_SIZE - page_offset);
+    memcpy(dest, &le->page[page_offset], chunk);
+
+    dest += chunk;
+    block_start += chunk;
+    block_size -= chunk;
+  }
+
+  xSemaphoreGive(le->lock);
+  return status;
+}
+
+
+bool log_evfs_write_block(void *ctx, size_t block_start, uint8_t *src, size_t block_size) {
+  LogEvfs *le = (LogEvfs *)ctx;
+
+  if(block_start > le->file_size || block_size > le->file_size - block_start)
+    return false;
+
+  bool status = true;
+  xSemaphoreTake(le->lock, portMAX_DELAY);
+
+  while(block_size > 0) {
+    if(!log_evfs__load_page(le, block_start)) {
+      status = false;
+      break;
+    }
+
+    size_t page_offset = block_start - le->page_start;
+    size_t chunk = min(block_size, LOG_EVFS_PAGE_SIZE - page_offset);
+    memcpy(&le->page[page_offset], src, chunk);
+    le->page_dirty = true;
+
+    src += chunk;
+    block_start += chunk;
+    block_size -= chunk;
+  }
+
+  xSemaphoreGive(le->lock);
+  return status;
+}
@@ -0,0 +1,124 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cstone/log_db.h"
+
+#include "log_mmap.h"
+
+/*
+Log DB memory mapped backend for hosted builds
+
+The log file is mapped shared into memory so that reads are direct accesses
+like the STM32 flash backend. Writes and erases modify the mapping and
+schedule write back of the affected pages with msync(). A newly created file
+is filled with 0xFF so it reads as erased flash.
+*/
+
+
+// Expand range to page boundaries and write it back
+static bool log_mmap__sync_range(LogMmap *lm, size_t start, size_t len, int flags) {
+  size_t page_mask = (size_t)sysconf(_SC_PAGESIZE) - 1;
+  size_t end = start + len;
+
+  start &= ~page_mask;
+  return msync(lm->base + start, end - start, flags) == 0;
+}
+
+
+bool log_mmap_open(LogMmap *lm, const char *path, size_t size) {
+  memset(lm, 0, sizeof(*lm));
+  lm->fd = -1;
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if(fd < 0)
+    return false;
+
+  struct stat st;
+  if(fstat(fd, &st) < 0)
+    goto cleanup;
+
+  bool new_file = (size_t)st.st_size < size;
+  if(new_file && ftruncate(fd, size) < 0)
+    goto cleanup;
+
+  uint8_t *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(base == MAP_FAILED)
+    goto cleanup;
+
+  lm->base = base;
+  lm->size = size;
+  lm->fd   = fd;
+
+  if(new_file) {
+    memset(base, 0xFF, size);
+    log_mmap_sync(lm);
+  }
+
+  return true;
+
+cleanup:
+  close(fd);
+  return false;
+}
+
+
+void log_mmap_close(LogMmap *lm) {
+  if(lm->base) {
+    log_mmap_sync(lm);
+    munmap(lm->base, lm->size);
+    lm->base = NULL;
+  }
+
+  if(lm->fd >= 0) {
+    close(lm->fd);
+    lm->fd = -1;
+  }
+}
+
+
+// Wait for all pending writes to reach the file
+bool log_mmap_sync(void *ctx) {
+  LogMmap *lm = (LogMmap *)ctx;
+  return log_mmap__sync_range(lm, 0, lm->size, MS_SYNC);
+}
+
+
+// ******************** Log DB mmap callbacks ********************
+
+
+void log_mmap_erase_sector(void *ctx, size_t sector_start, size_t sector_size) {
+  LogMmap *lm = (LogMmap *)ctx;
+
+  if(sector_start + sector_size > lm->size)
+    return;
+
+  memset(lm->base + sector_start, 0xFF, sector_size);
+  log_mmap__sync_range(lm, sector_start, sector_size, MS_SYNC);
+}
+
+
+bool log_mmap_read_block(void *ctx, size_t block_start, uint8_t *dest, size_t block_size) {
+  LogMmap *lm = (LogMmap *)ctx;
+
+  if(block_start + block_size > lm->size)
+    return false;
+
+  memcpy(dest, lm->base + block_start, block_size);
+  return true;
+}
+
+
+bool log_mmap_write_block(void *ctx, size_t block_start, uint8_t *src, size_t block_size) {
+  LogMmap *lm = (LogMmap *)ctx;
+
+  if(block_start + block_size > lm->size)
+    return false;
+
+  memcpy(lm->base + block_start, src, block_size);
+  return log_mmap__sync_range(lm, block_start, block_size, MS_ASYNC);
+}
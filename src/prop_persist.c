@@ -0,0 +1,140 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "cstone/prop_id.h"
+#include "cstone/prop_db.h"
+#include "cstone/log_db.h"
+#include "cstone/log_props.h"
+#include "cstone/rtos.h"
+#include "cstone/debug.h"
+#include "prop_persist.h"
+
+/*
+Persistence scheduler
+
+The prop DB raises persist_updated whenever a persistent prop changes. Saving
+on every change wears the flash and stalls on sector erases when the user is
+rapidly toggling settings. The scheduler claims the flag on each poll and
+delays the save until changes have stopped for the coalescing window or the
+oldest unsaved change reaches the maximum delay. All persistent props are then
+written as a single LogDB record.
+
+Flushes can come from the persist task, the console, and reset paths so the
+scheduler state and the LogDB write are serialized with a mutex. Fault handling
+uses a try-lock so a holder that will never run again can't block it. A failed
+write leaves the changes pending for a retry after another coalescing window.
+*/
+
+
+void prop_persist_init(PropPersist *pp, PropDB *db, LogDB *log_db, uint32_t window_ms,
+                       uint32_t max_delay_ms) {
+  memset(pp, 0, sizeof(*pp));
+  pp->db        = db;
+  pp->log_db    = log_db;
+  pp->window    = pdMS_TO_TICKS(window_ms);
+  pp->max_delay = pdMS_TO_TICKS(max_delay_ms);
+  pp->lock      = xSemaphoreCreateMutexStatic(&pp->lock_buf);
+}
+
+
+void prop_persist_set_sync(PropPersist *pp, PropPersistSync sync_storage, void *sync_ctx) {
+  pp->sync_storage = sync_storage;
+  pp->sync_ctx = sync_ctx;
+}
+
+
+// Caller must hold the lock
+static bool prop_persist__flush(PropPersist *pp) {
+  if(!pp->pending && !pp->db->persist_updated)
+    return false;
+
+  pp->db->persist_updated = false;
+
+  bool status = save_props_to_log(pp->db, pp->log_db, /*compress*/true);
+
+  if(pp->sync_storage)
+    status = pp->sync_storage(pp->sync_ctx) && status;
+
+  if(status) {
+    pp->pending = false;
+    pp->flushes++;
+  } else {  // Retry after another window
+    TickType_t now = xTaskGetTickCount();
+    pp->pending = true;
+    pp->first_change = now;
+    pp->last_change = now;
+    pp->failures++;
+  }
+
+  return status;
+}
+
+
+void prop_persist_poll(PropPersist *pp) {
+  xSemaphoreTake(pp->lock, portMAX_DELAY);
+
+  TickType_t now = xTaskGetTickCount();
+
+  if(pp->db->persist_updated) {
+    pp->db->persist_updated = false;
+    pp->changes++;
+    pp->last_change = now;
+
+    if(pp->pending) {
+      pp->coalesced++;
+    } else {
+      pp->pending = true;
+      pp->first_change = now;
+    }
+  }
+
+  if(pp->pending &&
+     ((now - pp->last_change) >= pp->window || (now - pp->first_change) >= pp->max_delay))
+    prop_persist__flush(pp);
+
+  xSemaphoreGive(pp->lock);
+}
+
+
+// Write pending changes immediately. Call before a controlled shutdown or reset.
+bool prop_persist_flush(PropPersist *pp) {
+  return prop_persist_try_flush(pp, portMAX_DELAY);
+}
+
+
+// Write pending changes if the lock can be taken within timeout. Use a zero
+// timeout from fault handling where the lock holder may never run again. Must
+// not be called from an interrupt.
+bool prop_persist_try_flush(PropPersist *pp, TickType_t timeout) {
+  if(!pp->lock || xSemaphoreTake(pp->lock, timeout) != pdTRUE)
+    return false;
+
+  bool status = prop_persist__flush(pp);
+  xSemaphoreGive(pp->lock);
+
+  return status;
+}
+
+
+static void prop_persist__task_cb(void *ctx) {
+  prop_persist_poll((PropPersist *)ctx);
+}
+
+
+void prop_persist_start(PropPersist *pp, uint32_t poll_ms) {
+  static PeriodicTaskCfg persist_task_cfg = {
+    .task   = prop_persist__task_cb,
+    .repeat = REPEAT_FOREVER
+  };
+
+  persist_task_cfg.ctx    = pp;
+  persist_task_cfg.period = poll_ms;
+
+  // Runs in its own task so flash erases don't stall the GUI
+  create_periodic_task("persist", STACK_BYTES(1024), TASK_PRIO_LOW, &persist_task_cfg);
+}
@@ -0,0 +1,119 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cstone/prop_id.h"
+#include "cstone/prop_db.h"
+#include "cstone/umsg.h"
+#include "prop_snapshot.h"
+
+/*
+Snapshot of hot props
+
+A fixed set of frequently read props is mirrored into an array protected by a
+per-slot sequence lock. The mirror is kept current by a hub callback target
+that receives the change messages generated by the prop DB. Readers never
+block or hash the prop ID. They retry only if they overlap a write to the
+same slot.
+
+Slots are found with the slot_of callback when provided. Otherwise the prop
+list is searched linearly. The hub target only subscribes to the P1.P2 groups
+that contain snapshot props so other traffic never reaches the handler.
+
+Without a hub the snapshot is only primed from the DB. Later changes must be
+written with prop_snapshot_set_slot().
+*/
+
+#define COMPILER_BARRIER()  __atomic_signal_fence(__ATOMIC_SEQ_CST)
+
+
+static void prop_snapshot__msg_handler(UMsgTarget *tgt, UMsg *msg) {
+  PropSnapshot *ps = (PropSnapshot *)tgt;
+
+  int slot = prop_snapshot_slot(ps, msg->id);
+  if(slot >= 0)
+    prop_snapshot_set_slot(ps, slot, (uint32_t)msg->payload);
+}
+
+
+void prop_snapshot_init(PropSnapshot *ps, const uint32_t *props, PropSnapshotSlot *slots,
+                        unsigned prop_count, PropSnapshotSlotOf slot_of, PropDB *db, UMsgHub *hub) {
+  ps->props = props;
+  ps->slots = slots;
+  ps->prop_count = prop_count;
+  ps->slot_of = slot_of;
+
+  memset(slots, 0, prop_count * sizeof(*slots));
+
+  // Prime with current DB state
+  PropDBEntry value;
+  for(unsigned i = 0; i < prop_count; i++) {
+    if(prop_get(db, props[i], &value))
+      slots[i].value = value.value;
+  }
+
+  umsg_tgt_callback_init(&ps->tgt, prop_snapshot__msg_handler);
+
+  // One filter per P1.P2 group covering the slot props
+  for(unsigned i = 0; i < prop_count; i++) {
+    uint32_t group = props[i] & (P1_MSK | P2_MSK);
+    bool seen = false;
+    for(unsigned j = 0; j < i; j++) {
+      if((props[j] & (P1_MSK | P2_MSK)) == group) {
+        seen = true;
+        break;
+      }
+    }
+
+    if(!seen)
+      umsg_tgt_add_filter(&ps->tgt, group | P3_MSK | P4_MSK);
+  }
+
+  if(hub)
+    umsg_hub_subscribe(hub, &ps->tgt);
+}
+
+
+int prop_snapshot_slot(PropSnapshot *ps, uint32_t prop) {
+  if(ps->slot_of)
+    return ps->slot_of(prop);
+
+  for(unsigned i = 0; i < ps->prop_count; i++) {
+    if(ps->props[i] == prop)
+      return i;
+  }
+
+  return -1;
+}
+
+
+void prop_snapshot_set_slot(PropSnapshot *ps, unsigned slot, uint32_t value) {
+  PropSnapshotSlot *s = &ps->slots[slot];
+
+  // Writers are serialized so readers only have to check the sequence
+  taskENTER_CRITICAL();
+    s->seq++;
+    COMPILER_BARRIER();
+    s->value = value;
+    COMPILER_BARRIER();
+    s->seq++;
+  taskEXIT_CRITICAL();
+}
+
+
+uint32_t prop_snapshot_read_slot(PropSnapshot *ps, unsigned slot) {
+  PropSnapshotSlot *s = &ps->slots[slot];
+  uint32_t seq, value;
+
+  do {
+    seq = s->seq;
+    COMPILER_BARRIER();
+    value = s->value;
+    COMPILER_BARRIER();
+  } while((seq & 0x01) || seq != s->seq);
+
+  return value;
+}
@@ -124,9 +124,6 @@ void SysTick_Handler(void) {
   if(g_enable_rtos_sys_tick)
     xPortSysTickHandler();
   HAL_IncTick();
-#ifdef USE_LVGL
-  lv_tick_inc(1);
-#endif
 }
 
 
@@ -152,9 +152,6 @@ void SysTick_Handler(void) {
   if(g_enable_rtos_sys_tick)
     xPortSysTickHandler();
   HAL_IncTick();
-#if USE_LVGL
-  lv_tick_inc(1);
-#endif
 }
 
 
@@ -225,6 +222,26 @@ void OTG_HS_IRQHandler(void) {
 }
 #endif
 
+#if USE_LVGL && defined BOARD_STM32F429I_DISC1
+extern void lcd_dma2d_irq(void);
+
+// LVGL flush transfer complete
+void DMA2D_IRQHandler(void);
+void DMA2D_IRQHandler(void) {
+  lcd_dma2d_irq();
+}
+
+#  ifdef USE_DOUBLE_BUF
+extern LTDC_HandleTypeDef LtdcHandler;
+
+// Frame buffer swap on reload
+void LTDC_IRQHandler(void);
+void LTDC_IRQHandler(void) {
+  HAL_LTDC_IRQHandler(&LtdcHandler);
+}
+#  endif
+#endif
+
 #if USE_AUDIO
 extern SynthState g_audio_synth;
 extern SampleDevice *g_dev_audio;
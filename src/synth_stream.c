@@ -0,0 +1,272 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cstone/rtos.h"
+#include "cstone/debug.h"
+#include "cstone/iqueue_int16_t.h"
+#include "util/minmax.h"
+
+#include "evfs.h"
+#include "sample_device.h"
+#include "audio_synth.h"
+#include "synth_stream.h"
+
+/*
+Streaming sample playback
+
+A sample voice reads PCM from a SynthStream rather than generating a waveform.
+The render loop runs at high priority and must never wait on the filesystem so
+all file access happens in a low priority filler task. Each stream has two
+buffers. The render loop consumes one while the filler reads ahead into the
+other. Ownership of a buffer passes between them through its count field so no
+locks are needed. If the filler falls behind, the render loop outputs silence
+and counts an underrun instead of stalling.
+
+The render loop can't wake the filler because it also runs from the SDL audio
+callback on hosted builds. The filler blocks on a task notification while no
+stream is open. While a stream plays it sleeps for half the playback time of a
+buffer, which is when the render loop will next release one.
+
+synth_play_file() runs in the console task. It only posts the primed stream
+to the synth and the render loop claims a voice for it on its next pass. The
+voice list is only changed by the render loop.
+
+Files are WAV (PCM, mono, 8 or 16-bit) or raw 16-bit mono at the synth sample
+rate. Sample rate conversion is nearest neighbor. Samples are assumed to be
+little-endian like the host.
+*/
+
+#define MAX_RATE_RATIO  4   // Limit on file rate / synth rate
+
+static SynthStream s_streams[SYNTH_MAX_STREAMS];
+static EvfsFile *s_stream_files[SYNTH_MAX_STREAMS]; // NULL when stream is free
+static TaskHandle_t s_stream_task = NULL;
+
+
+static inline uint16_t get_le16(const uint8_t *buf) {
+  return buf[0] | (uint16_t)buf[1] << 8;
+}
+
+static inline uint32_t get_le32(const uint8_t *buf) {
+  return get_le16(buf) | (uint32_t)get_le16(&buf[2]) << 16;
+}
+
+
+static bool synth_stream__read_exact(EvfsFile *fh, void *buf, size_t size) {
+  return evfs_file_read(fh, buf, size) == (ptrdiff_t)size;
+}
+
+
+// Parse WAV headers and leave the file positioned at the start of sample data
+static bool synth_stream__parse_wav(SynthStream *stream, EvfsFile *fh, uint32_t *sample_rate) {
+  uint8_t hdr[16];
+
+  if(!synth_stream__read_exact(fh, hdr, 12))
+    return false;
+
+  if(memcmp(hdr, "RIFF", 4) || memcmp(&hdr[8], "WAVE", 4)) { // Raw PCM
+    evfs_off_t file_size = evfs_file_size(fh);
+    if(file_size <= 0 || evfs_file_seek(fh, 0, EVFS_SEEK_TO) != EVFS_OK)
+      return false;
+
+    stream->sample_bytes = 2;
+    stream->data_remain = file_size;
+    return true;
+  }
+
+  bool have_fmt = false;
+  while(synth_stream__read_exact(fh, hdr, 8)) {
+    uint32_t chunk_size = get_le32(&hdr[4]);
+
+    if(!memcmp(hdr, "data", 4)) {
+      if(!have_fmt)
+        return false;
+      stream->data_remain = chunk_size;
+      return true;
+    }
+
+    uint32_t skip = chunk_size + (chunk_size & 1); // Chunks are padded to even size
+
+    if(!memcmp(hdr, "fmt ", 4)) {
+      if(chunk_size < 16 || !synth_stream__read_exact(fh, hdr, 16))
+        return false;
+
+      uint16_t format    = get_le16(&hdr[0]);
+      uint16_t channels  = get_le16(&hdr[2]);
+      uint16_t bits      = get_le16(&hdr[14]);
+      *sample_rate       = get_le32(&hdr[4]);
+
+      if(format != 1 || channels != 1 || (bits != 8 && bits != 16)) {
+        DPRINT("Unsupported WAV: fmt=%d ch=%d bits=%d", format, channels, bits);
+        return false;
+      }
+
+      stream->sample_bytes = bits / 8;
+      have_fmt = true;
+      skip -= 16;
+    }
+
+    if(skip > 0 && evfs_file_seek(fh, skip, EVFS_SEEK_REL) != EVFS_OK)
+      return false;
+  }
+
+  return false; // No data chunk
+}
+
+
+// Read ahead into any buffers the render loop has released
+static void synth_stream__fill(SynthStream *stream, EvfsFile *fh) {
+  while(!stream->eof) {
+    SynthStreamBuf *buf = &stream->bufs[stream->fill_buf];
+    if(__atomic_load_n(&buf->count, __ATOMIC_ACQUIRE) != 0) // Still in use
+      break;
+
+    size_t read_bytes = min((size_t)stream->data_remain,
+                            (size_t)SYNTH_STREAM_BUF_SAMPLES * stream->sample_bytes);
+    uint8_t *dest = (uint8_t *)buf->samples;
+    if(stream->sample_bytes == 1) // Read into upper half and expand in place
+      dest += SYNTH_STREAM_BUF_SAMPLES;
+
+    ptrdiff_t got = evfs_file_read(fh, dest, read_bytes);
+    uint16_t count = got > 0 ? got / stream->sample_bytes : 0;
+
+    if(stream->sample_bytes == 1) {
+      for(uint16_t i = 0; i < count; i++) {
+        buf->samples[i] = ((int16_t)dest[i] - 128) << 8;
+      }
+    }
+
+    if(count == 0) { // Read error or trailing partial sample
+      stream->data_remain = 0;
+    } else {
+      stream->data_remain -= count * stream->sample_bytes;
+      __atomic_store_n(&buf->count, count, __ATOMIC_RELEASE);
+      stream->fill_buf ^= 1;
+    }
+
+    if(stream->data_remain == 0)
+      __atomic_store_n(&stream->eof, true, __ATOMIC_RELEASE);
+  }
+}
+
+
+// Start playing a sample file on a new voice. Returns NULL on error or if all
+// streams are in use.
+SynthStream *synth_play_file(SynthState *synth, const char *path) {
+  int slot = -1;
+  for(int i = 0; i < SYNTH_MAX_STREAMS; i++) {
+    if(!__atomic_load_n(&s_stream_files[i], __ATOMIC_ACQUIRE)) {
+      slot = i;
+      break;
+    }
+  }
+
+  if(slot < 0)
+    return NULL;
+
+  EvfsFile *fh;
+  if(evfs_open(path, &fh, EVFS_READ) != EVFS_OK)
+    return NULL;
+
+  SynthStream *stream = &s_streams[slot];
+  memset(stream, 0, sizeof(*stream));
+
+  uint32_t sample_rate = synth->sample_rate;
+  if(!synth_stream__parse_wav(stream, fh, &sample_rate) || sample_rate == 0 ||
+      sample_rate > synth->sample_rate * MAX_RATE_RATIO) {
+    evfs_file_close(fh);
+    return NULL;
+  }
+
+  stream->step = ((uint64_t)sample_rate << 16) / synth->sample_rate;
+
+  // Prime both buffers before the voice starts
+  synth_stream__fill(stream, fh);
+
+  // The render loop starts the voice on its next pass
+  if(!synth_add_stream_voice(synth, stream)) {
+    evfs_file_close(fh);
+    return NULL;
+  }
+
+  // Hand off to the filler task
+  __atomic_store_n(&s_stream_files[slot], fh, __ATOMIC_RELEASE);
+  if(s_stream_task)
+    xTaskNotifyGive(s_stream_task);
+
+  return stream;
+}
+
+
+// Half the time for the render loop to consume one buffer of a stream
+static TickType_t synth_stream__fill_period(SynthStream *stream, SynthState *synth) {
+  uint32_t out_samples = ((uint32_t)SYNTH_STREAM_BUF_SAMPLES << 16) / stream->step;
+  uint32_t period_ms = out_samples * 1000 / synth->sample_rate / 2;
+  TickType_t period = pdMS_TO_TICKS(period_ms);
+
+  return period > 0 ? period : 1;
+}
+
+
+// Service open streams. Returns time until the next fill is due.
+static TickType_t synth_stream__service(SynthState *synth) {
+  TickType_t sleep = portMAX_DELAY; // Wait for synth_play_file() when idle
+
+  for(int i = 0; i < SYNTH_MAX_STREAMS; i++) {
+    EvfsFile *fh = __atomic_load_n(&s_stream_files[i], __ATOMIC_ACQUIRE);
+    if(!fh)
+      continue;
+
+    SynthStream *stream = &s_streams[i];
+    int8_t voice = __atomic_load_n(&stream->voice, __ATOMIC_ACQUIRE);
+    if(voice < 0) { // Render loop hasn't started the voice yet
+      sleep = min(sleep, synth_stream__fill_period(stream, synth));
+      continue;
+    }
+
+    SynthVoice *vox = &synth->voices[voice];
+    bool stolen = vox->osc.stream != stream;
+
+    if(!stolen && !(stream->finished && vox->adsr.state == ADSR_IDLE)) {
+      synth_stream__fill(stream, fh);
+      sleep = min(sleep, synth_stream__fill_period(stream, synth));
+      continue;
+    }
+
+    // Playback is over. Detach the idle voice so the stream can be reused.
+    if(!stolen) {
+      vox->osc.kind = OSC_NONE;
+      vox->osc.stream = NULL;
+    }
+
+    if(stream->underruns > 0)
+      DPRINT("Stream underruns: %" PRIu32, stream->underruns);
+
+    evfs_file_close(fh);
+    __atomic_store_n(&s_stream_files[i], NULL, __ATOMIC_RELEASE);
+  }
+
+  return sleep;
+}
+
+
+static void synth_stream__task(void *ctx) {
+  SynthState *synth = (SynthState *)ctx;
+
+  while(1) {
+    TickType_t sleep = synth_stream__service(synth);
+    ulTaskNotifyTake(/*xClearCountOnExit*/ pdTRUE, sleep);
+  }
+}
+
+
+void synth_stream_task_init(SynthState *synth) {
+  // Low priority so file reads never delay the synth task
+  xTaskCreate(synth_stream__task, "sstream", STACK_BYTES(1024), synth, TASK_PRIO_LOW,
+              &s_stream_task);
+}
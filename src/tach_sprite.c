@@ -0,0 +1,178 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "lib_cfg/build_config.h"
+#include "lvgl/lvgl.h"
+#include "tach_sprite.h"
+
+/*
+Pre-rendered tacho arc
+
+The corner of the bar graph tacho is an antialiased quarter arc. Drawing it as
+an lv_arc rasterizes the arc again on every RPM change. Instead, every fill
+level is rendered once at boot into a strip of 8-bit alpha masks. The full
+ring frame doubles as the track.
+
+Masks are colored at draw time so a theme change only changes the track color
+and nothing is re-rendered. At one byte per pixel the 101 frames of 40x40 take
+161,600 bytes. TRUE_COLOR_ALPHA frames would take 484,800 bytes at 16-bit
+color and 646,400 bytes at 32-bit. Even the masks don't fit in internal RAM so
+sprites are only built for boards with SDRAM.
+
+The sprite object draws the track and the frame for the current percentage.
+A value change only invalidates the bounding box of the arc segment between
+the old and new angle, so a one percent step redraws a few pixels and not the
+whole quadrant.
+*/
+
+#define SPRITE_BYTES  (TACH_SPRITE_SIZE * TACH_SPRITE_SIZE)
+
+#if defined BOARD_STM32F429I_DISC1 || defined BOARD_STM32F429N_EVAL
+__attribute__(( section(".sdram") ))
+#elif defined PLATFORM_EMBEDDED
+#  error "Tacho sprites need SDRAM"
+#endif
+static uint8_t s_sprite_pixels[TACH_SPRITE_STEPS][SPRITE_BYTES];
+
+static lv_img_dsc_t s_sprites[TACH_SPRITE_STEPS];
+
+static lv_coord_t s_arc_width;
+static lv_color_t s_ind_color;
+static lv_color_t s_track_color;
+static unsigned s_value;  // Percentage shown
+
+#define TRACK_SPRITE  (&s_sprites[TACH_SPRITE_STEPS-1])
+
+
+// Angles match the lv_arc this replaces with 180 deg. rotation
+static inline int16_t tach_sprite__angle(unsigned pct) {
+  return 180 + 90 * pct / (TACH_SPRITE_STEPS-1);
+}
+
+
+// Render all fill levels
+bool tach_sprite_init(lv_coord_t arc_width, lv_color_t ind_color, lv_color_t track_color) {
+  s_arc_width   = arc_width;
+  s_ind_color   = ind_color;
+  s_track_color = track_color;
+  s_value = 0;
+
+  // Render in color to a scratch buffer since canvas drawing doesn't support
+  // alpha only formats. Coverage is recovered from the brightness.
+  lv_color_t *scratch = lv_mem_alloc(LV_CANVAS_BUF_SIZE_TRUE_COLOR(TACH_SPRITE_SIZE, TACH_SPRITE_SIZE));
+  if(!scratch)
+    return false;
+
+  lv_obj_t *canvas = lv_canvas_create(lv_layer_sys());
+  if(!canvas) {
+    lv_mem_free(scratch);
+    return false;
+  }
+
+  lv_obj_add_flag(canvas, LV_OBJ_FLAG_HIDDEN);
+  lv_canvas_set_buffer(canvas, scratch, TACH_SPRITE_SIZE, TACH_SPRITE_SIZE, LV_IMG_CF_TRUE_COLOR);
+
+  lv_draw_arc_dsc_t arc_dsc;
+  lv_draw_arc_dsc_init(&arc_dsc);
+  arc_dsc.color   = lv_color_white();
+  arc_dsc.width   = arc_width;
+  arc_dsc.rounded = 0;
+
+  for(unsigned pct = 0; pct < TACH_SPRITE_STEPS; pct++) {
+    uint8_t *alpha = s_sprite_pixels[pct];
+
+    lv_canvas_fill_bg(canvas, lv_color_black(), LV_OPA_COVER);
+    if(pct > 0) {
+      // Arc center is the bottom right corner
+      lv_canvas_draw_arc(canvas, TACH_SPRITE_SIZE, TACH_SPRITE_SIZE, TACH_SPRITE_SIZE,
+                         180, tach_sprite__angle(pct), &arc_dsc);
+    }
+
+    for(unsigned i = 0; i < SPRITE_BYTES; i++) {
+      alpha[i] = lv_color_brightness(scratch[i]);
+    }
+
+    lv_img_dsc_t *sprite = &s_sprites[pct];
+    memset(sprite, 0, sizeof(*sprite));
+    sprite->header.cf = LV_IMG_CF_ALPHA_8BIT;
+    sprite->header.w  = TACH_SPRITE_SIZE;
+    sprite->header.h  = TACH_SPRITE_SIZE;
+    sprite->data_size = SPRITE_BYTES;
+    sprite->data      = alpha;
+  }
+
+  lv_obj_del(canvas);
+  lv_mem_free(scratch);
+  return true;
+}
+
+
+static void tach_sprite__draw_cb(lv_event_t *e) {
+  lv_obj_t *obj = lv_event_get_target(e);
+  lv_draw_ctx_t *draw_ctx = lv_event_get_draw_ctx(e);
+
+  lv_area_t coords;
+  lv_obj_get_coords(obj, &coords);
+
+  // Alpha masks take their color from recolor. Blending is clipped to the
+  // invalidated area.
+  lv_draw_img_dsc_t img_dsc;
+  lv_draw_img_dsc_init(&img_dsc);
+  img_dsc.recolor_opa = LV_OPA_COVER;
+
+  img_dsc.recolor = s_track_color;
+  lv_draw_img(draw_ctx, &img_dsc, &coords, TRACK_SPRITE);
+  if(s_value > 0) {
+    img_dsc.recolor = s_ind_color;
+    lv_draw_img(draw_ctx, &img_dsc, &coords, &s_sprites[s_value]);
+  }
+}
+
+
+// Create object that shows the sprites. Call after tach_sprite_init().
+lv_obj_t *tach_sprite_create(lv_obj_t *parent) {
+  lv_obj_t *obj = lv_obj_create(parent);
+  if(!obj)
+    return NULL;
+
+  lv_obj_remove_style_all(obj);
+  lv_obj_set_size(obj, TACH_SPRITE_SIZE, TACH_SPRITE_SIZE);
+  lv_obj_clear_flag(obj, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+  lv_obj_add_event_cb(obj, tach_sprite__draw_cb, LV_EVENT_DRAW_MAIN, NULL);
+  return obj;
+}
+
+
+void tach_sprite_set_value(lv_obj_t *obj, unsigned pct) {
+  if(pct >= TACH_SPRITE_STEPS)
+    pct = TACH_SPRITE_STEPS-1;
+
+  if(pct == s_value)
+    return;
+
+  int16_t start = tach_sprite__angle(LV_MIN(pct, s_value));
+  int16_t end   = tach_sprite__angle(LV_MAX(pct, s_value));
+  s_value = pct;
+
+  // The arc is monotonic in x and y within the quadrant so the changed segment
+  // is bounded by its corners on the outer and inner radius.
+  lv_coord_t outer = TACH_SPRITE_SIZE;
+  lv_coord_t inner = TACH_SPRITE_SIZE - s_arc_width;
+  lv_area_t seg;
+  seg.x1 = TACH_SPRITE_SIZE + ((outer * lv_trigo_cos(start)) >> LV_TRIGO_SHIFT) - 1;
+  seg.x2 = TACH_SPRITE_SIZE + ((inner * lv_trigo_cos(end))   >> LV_TRIGO_SHIFT) + 1;
+  seg.y1 = TACH_SPRITE_SIZE + ((outer * lv_trigo_sin(end))   >> LV_TRIGO_SHIFT) - 1;
+  seg.y2 = TACH_SPRITE_SIZE + ((inner * lv_trigo_sin(start)) >> LV_TRIGO_SHIFT) + 1;
+
+  lv_area_t coords;
+  lv_obj_get_coords(obj, &coords);
+  lv_area_move(&seg, coords.x1, coords.y1);
+  lv_obj_invalidate_area(obj, &seg);
+}
+
+
+void tach_sprite_set_track_color(lv_obj_t *obj, lv_color_t color) {
+  s_track_color = color;
+  lv_obj_invalidate(obj);
+}
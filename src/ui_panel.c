@@ -17,59 +17,57 @@ extern mpPoolSet g_pool_set;
 
 // ******************** UI panel ********************
 
-static void panel_item_destroy(dhKey key, void *value, void *ctx) {
-  lv_obj_t *obj = (lv_obj_t *)value;
-
-  lv_obj_del(obj);
-}
+bool ui_panel_init(UIPanel *panel, uint16_t obj_count) {
+  // Widgets are looked up by direct index on every GUI update
+  panel->objs = NULL;
+  panel->values = NULL;
+  panel->obj_count = 0;
+
+  if(obj_count > 0) {
+    panel->objs = calloc(obj_count, sizeof(lv_obj_t *));
+    panel->values = malloc(obj_count * sizeof(int32_t));
+    if(!panel->objs || !panel->values) {
+      free(panel->objs);
+      free(panel->values);
+      panel->objs = NULL;
+      panel->values = NULL;
+      return false;
+    }
 
-bool ui_panel_init(UIPanel *panel) {
-  // Setup hash table for widget prop: lv_obj_t * pairs
-  dhConfig hash_cfg = {
-    .init_buckets = 8,
-    .value_size   = sizeof(lv_obj_t *),
-    .max_storage  = 0,
-    .ext_storage  = NULL,
-    .destroy_item = panel_item_destroy,
-    .replace_item = NULL,
-    .gen_hash     = dh_gen_hash_int,
-    .is_equal     = dh_equal_hash_keys_int
-  };
+    for(uint16_t i = 0; i < obj_count; i++) {
+      panel->values[i] = UI_VALUE_NONE;
+    }
+    panel->obj_count = obj_count;
+  }
 
-  return dh_init(&panel->hash, &hash_cfg, panel);
+  return true;
 }
 
 void ui_panel_free(UIPanel *panel) {
-  dh_free(&panel->hash);
-}
-
-
-bool ui_panel_add_obj(UIPanel *panel, uint32_t id, lv_obj_t *obj) {
-  dhKey key = {
-    .data = (void *)(uintptr_t)id,
-    .length = sizeof(uint32_t)
-  };
+  for(uint16_t i = 0; i < panel->obj_count; i++) {
+    if(panel->objs[i])
+      lv_obj_del(panel->objs[i]);
+  }
 
-  return dh_insert(&panel->hash, key, &obj);
+  free(panel->objs);
+  free(panel->values);
+  panel->objs = NULL;
+  panel->values = NULL;
+  panel->obj_count = 0;
 }
 
 
-lv_obj_t *ui_panel_get_obj(UIPanel *panel, uint32_t id) {
-  lv_obj_t *obj = NULL;
-  dhKey key = {
-    .data = (void *)(uintptr_t)id,
-    .length = sizeof(uint32_t)
-  };
-
-  if(!dh_lookup(&panel->hash, key, &obj))
-    return NULL;
+bool ui_panel_add_obj(UIPanel *panel, unsigned id, lv_obj_t *obj) {
+  if(id >= panel->obj_count)
+    return false;
 
-  return obj;
+  panel->objs[id] = obj;
+  panel->values[id] = UI_VALUE_NONE;
+  return true;
 }
 
 
 
-
 // ******************** UI styles ********************
 
 static void style_item_destroy(dhKey key, void *value, void *ctx) {
@@ -223,6 +221,7 @@ bool ui_react_widgets_init(UIReactWidgets *rw) {
     .is_equal     = dh_equal_hash_keys_int
   };
 
+  rw->prop_filter = 0;
   return dh_init(&rw->hash, &hash_cfg, rw);
 }
 
@@ -248,7 +247,13 @@ UIReactWidgetNode *ui_react_widgets_get(UIReactWidgets *rw, uint32_t prop) {
 }
 
 
-bool ui_react_widgets_bind(UIReactWidgets *rw, uint32_t prop, lv_obj_t *widget) {
+// Bloom filter bit for a prop. Collisions only cost a hash lookup.
+static inline uint32_t react_widgets__filter_bit(uint32_t prop) {
+  return 1ul << ((prop ^ (prop >> 5) ^ (prop >> 13) ^ (prop >> 24)) & 0x1F);
+}
+
+
+bool ui_react_widgets_bind(UIReactWidgets *rw, UIWidgetRegistry *wreg, uint32_t prop, lv_obj_t *widget) {
   UIReactWidgetNode *node;
 
   // Check if widget is already bound to this prop
@@ -259,6 +264,11 @@ bool ui_react_widgets_bind(UIReactWidgets *rw, uint32_t prop, lv_obj_t *widget)
     node = node->next;
   }
 
+  // Lookup widget type in registry once rather than on every update
+  UIWidgetEntry entry;
+  if(!ui_widget_reg_get(wreg, lv_obj_get_class(widget), &entry))
+    return false;
+
   bool status = false;
 
   // Lookup any existing binding for this prop
@@ -267,8 +277,10 @@ bool ui_react_widgets_bind(UIReactWidgets *rw, uint32_t prop, lv_obj_t *widget)
     UIReactWidgetNode *new_node = mp_alloc(&g_pool_set, sizeof(UIReactWidgetNode), NULL);
     if(new_node) {
       new_node->widget = widget;
+      new_node->update_widget = entry.update_widget;
       // Insert after first widget node so we don't have to change hash table
       ll_slist_add_after(&node, new_node);
+      status = true;
 
 //      printf("## RW BIND 2: %p\n", new_node);
     }
@@ -283,30 +295,30 @@ bool ui_react_widgets_bind(UIReactWidgets *rw, uint32_t prop, lv_obj_t *widget)
 
       node->next = NULL;
       node->widget = widget;
+      node->update_widget = entry.update_widget;
       status = dh_insert(&rw->hash, key, &node);
 //      printf("## RW BIND: %p\n", node);
     }
   }
 
+  if(status)
+    rw->prop_filter |= react_widgets__filter_bit(prop);
+
   return status;
 }
 
 
-void ui_react_widgets_update(UIReactWidgets *rw, UIWidgetRegistry *wreg, uint32_t prop) {
+void ui_react_widgets_update(UIReactWidgets *rw, uint32_t prop) {
+  // Most updates are for sensor props with no bound widgets
+  if(!(rw->prop_filter & react_widgets__filter_bit(prop)))
+    return;
+
   UIReactWidgetNode *node = ui_react_widgets_get(rw, prop);
 
 //  printf("## REACT: P%08lX  %p\n", prop, node);
 
   while(node) {
-    const lv_obj_class_t *obj_class = lv_obj_get_class(node->widget);
-
-    // Lookup widget type in registry
-    UIWidgetEntry entry;
-    if(ui_widget_reg_get(wreg, obj_class, &entry)) {
-//      printf("   W REG: %p", entry.update_widget);
-      entry.update_widget(node->widget, prop);
-    }
-
+    node->update_widget(node->widget, prop);
     node = node->next;
   }
 
@@ -0,0 +1,334 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cstone/prop_id.h"
+#include "cstone/umsg.h"
+#include "cstone/rtos.h"
+#include "cstone/debug.h"
+#include "umsg_batch.h"
+
+/*
+Batched UMsg delivery
+
+The router subscribes a single catch-all callback target to the hub. Filters
+added to the router are indexed by their P1|P2 prefix so each message only
+tests the filters sharing its prefix plus any with a wildcard P1 or P2 field.
+Matching messages are queued with the set of targets they belong to. A
+delivery task drains the queue after the senders go idle and invokes each
+batch target's handler once with every message it matched.
+
+Coalescing storage holds only the latest message for a fixed set of props.
+Producers mark the prop dirty and the consumer drains at most one message per
+prop, bounding its work by its own rate rather than the update rate. A batch
+target can attach coalescing storage for the props it can't afford to lose.
+Those are stored by the hub handler instead of queued, so a queue filled by
+other traffic never drops their latest value.
+*/
+
+#define PREFIX_MASK   (P1_MSK | P2_MSK)
+
+
+static inline unsigned umsg_batch__hash_prefix(uint32_t prefix) {
+  uint32_t h = prefix >> 16;
+  h ^= h >> 7;
+  return h & (UMSG_BATCH_INDEX_SLOTS-1);
+}
+
+
+static bool umsg_batch__filter_match(uint32_t filter, uint32_t id) {
+  static const uint32_t s_field_masks[] = {P1_MSK, P2_MSK, P3_MSK, P4_MSK};
+
+  for(unsigned i = 0; i < 4; i++) {
+    uint32_t fmask = s_field_masks[i];
+    if((filter & fmask) == fmask) // Wildcard field
+      continue;
+    if((filter & fmask) != (id & fmask))
+      return false;
+  }
+
+  return true;
+}
+
+
+static UMsgBatchIndexSlot *umsg_batch__index_find(UMsgBatchRouter *router, uint32_t prefix,
+                                                  bool insert) {
+  unsigned slot = umsg_batch__hash_prefix(prefix);
+
+  // Linear probe. Empty slots have no filters.
+  for(unsigned i = 0; i < UMSG_BATCH_INDEX_SLOTS; i++) {
+    UMsgBatchIndexSlot *entry = &router->index[slot];
+    if(entry->filter_set == 0)
+      return insert ? entry : NULL;
+    if(entry->prefix == prefix)
+      return entry;
+
+    slot = (slot + 1) & (UMSG_BATCH_INDEX_SLOTS-1);
+  }
+
+  return NULL;
+}
+
+
+static uint8_t umsg_batch__match_targets(UMsgBatchRouter *router, uint32_t id) {
+  uint16_t filter_set = router->wild_filters;
+
+  UMsgBatchIndexSlot *entry = umsg_batch__index_find(router, id & PREFIX_MASK, /*insert*/false);
+  if(entry)
+    filter_set |= entry->filter_set;
+
+  uint8_t target_set = 0;
+  while(filter_set) {
+    unsigned f = __builtin_ctz(filter_set);
+    filter_set &= filter_set - 1;
+
+    UMsgBatchFilter *filter = &router->filters[f];
+    if(!(target_set & (1u << filter->target)) && umsg_batch__filter_match(filter->filter, id))
+      target_set |= 1u << filter->target;
+  }
+
+  return target_set;
+}
+
+
+static int umsg_coalesce__put(UMsgCoalesce *co, UMsg *msg);
+
+// Runs in the context of the task sending to the hub
+static void umsg_batch__hub_handler(UMsgTarget *tgt, UMsg *msg) {
+  UMsgBatchRouter *router = (UMsgBatchRouter *)tgt;
+
+  uint8_t target_set = umsg_batch__match_targets(router, msg->id);
+  if(target_set == 0)
+    return;
+
+  bool notify = false;
+
+  // Store coalesced props for each target in place of queuing them
+  for(uint8_t ts = target_set; ts; ts &= ts - 1) {
+    unsigned t = __builtin_ctz(ts);
+    UMsgCoalesce *co = router->targets[t]->coalesce;
+    if(!co)
+      continue;
+
+    int status = umsg_coalesce__put(co, msg);
+    if(status >= 0) {
+      target_set &= ~(1u << t);
+      notify |= (status > 0);
+    }
+  }
+
+  if(target_set != 0) {
+    taskENTER_CRITICAL();
+      if(router->pending_count < UMSG_BATCH_QUEUE_SIZE) {
+        UMsgBatchPending *p = &router->pending[router->pending_count++];
+        p->msg = *msg;
+        p->target_set = target_set;
+        notify |= (router->pending_count == 1);
+      } else {
+        router->dropped++;
+      }
+    taskEXIT_CRITICAL();
+  }
+
+  if(notify && router->task)
+    xTaskNotifyGive(router->task);
+}
+
+
+void umsg_batch_init(UMsgBatchRouter *router, UMsgHub *hub) {
+  memset(router, 0, sizeof(*router));
+
+  umsg_tgt_callback_init(&router->tgt, umsg_batch__hub_handler);
+  umsg_tgt_add_filter(&router->tgt, (P1_MSK | P2_MSK | P3_MSK | P4_MSK));
+  umsg_hub_subscribe(hub, &router->tgt);
+}
+
+
+bool umsg_batch_add_target(UMsgBatchRouter *router, UMsgBatchTarget *btgt, UMsgBatchHandler handler,
+                           void *ctx) {
+  if(router->target_count >= UMSG_BATCH_MAX_TARGETS)
+    return false;
+
+  btgt->handler = handler;
+  btgt->ctx = ctx;
+  btgt->coalesce = NULL;
+  router->targets[router->target_count++] = btgt;
+  return true;
+}
+
+
+bool umsg_batch_add_filter(UMsgBatchRouter *router, UMsgBatchTarget *btgt, uint32_t filter) {
+  if(router->filter_count >= UMSG_BATCH_MAX_FILTERS)
+    return false;
+
+  // Find target index
+  unsigned t;
+  for(t = 0; t < router->target_count; t++) {
+    if(router->targets[t] == btgt)
+      break;
+  }
+  if(t >= router->target_count)
+    return false;
+
+  unsigned f = router->filter_count;
+  uint32_t prefix = filter & PREFIX_MASK;
+  if((filter & P1_MSK) == P1_MSK || (filter & P2_MSK) == P2_MSK) {
+    router->wild_filters |= 1u << f;
+
+  } else {
+    UMsgBatchIndexSlot *entry = umsg_batch__index_find(router, prefix, /*insert*/true);
+    if(!entry)
+      return false;
+    entry->prefix = prefix;
+    entry->filter_set |= 1u << f;
+  }
+
+  router->filters[f] = (UMsgBatchFilter){.filter = filter, .target = t};
+  router->filter_count++;
+  return true;
+}
+
+
+// Attach coalescing storage to a target. Call before the router is started.
+void umsg_batch_set_coalesce(UMsgBatchTarget *btgt, UMsgCoalesce *co) {
+  btgt->coalesce = co;
+}
+
+
+static unsigned umsg_coalesce__take(UMsgCoalesce *co, UMsg *msgs);
+
+void umsg_batch_drain(UMsgBatchRouter *router) {
+  unsigned count;
+
+  taskENTER_CRITICAL();
+    count = router->pending_count;
+    memcpy(router->draining, router->pending, count * sizeof(*router->pending));
+    router->pending_count = 0;
+  taskEXIT_CRITICAL();
+
+  // Gather latest coalesced props then queued messages in their original order
+  for(unsigned t = 0; t < router->target_count; t++) {
+    UMsgCoalesce *co = router->targets[t]->coalesce;
+    unsigned batch_count = co ? umsg_coalesce__take(co, router->batch) : 0;
+
+    for(unsigned i = 0; i < count; i++) {
+      if(router->draining[i].target_set & (1u << t))
+        router->batch[batch_count++] = router->draining[i].msg;
+    }
+
+    if(batch_count > 0) {
+      UMsgBatchTarget *btgt = router->targets[t];
+      btgt->handler(btgt, router->batch, batch_count);
+    }
+  }
+}
+
+
+static void umsg_batch__task(void *ctx) {
+  UMsgBatchRouter *router = (UMsgBatchRouter *)ctx;
+
+  while(1) {
+    // Deliver anything queued before the task started
+    umsg_batch_drain(router);
+    ulTaskNotifyTake(/*xClearCountOnExit*/ pdTRUE, portMAX_DELAY);
+  }
+}
+
+
+bool umsg_batch_start(UMsgBatchRouter *router, UBaseType_t priority) {
+  BaseType_t status = xTaskCreate(umsg_batch__task, "umsgB", STACK_BYTES(2048),
+                                  router, priority, &router->task);
+  if(status != pdPASS) {
+    DPRINT("Failed to create batch task");
+    return false;
+  }
+
+  return true;
+}
+
+
+// ******************** Coalescing ********************
+
+bool umsg_coalesce_init(UMsgCoalesce *co, const uint32_t *props, UMsg *latest, unsigned prop_count) {
+  if(prop_count > UMSG_COALESCE_MAX_PROPS)
+    return false;
+
+  memset(co, 0, sizeof(*co));
+  co->props = props;
+  co->latest = latest;
+  co->prop_count = prop_count;
+  return true;
+}
+
+
+// Returns -1 if the message isn't for a coalesced prop, 0 if it replaced an
+// undelivered message, and 1 if the prop became dirty
+static int umsg_coalesce__put(UMsgCoalesce *co, UMsg *msg) {
+  unsigned slot;
+  for(slot = 0; slot < co->prop_count; slot++) {
+    if(co->props[slot] == msg->id)
+      break;
+  }
+  if(slot >= co->prop_count)
+    return -1;
+
+  uint32_t slot_bit = 1ul << slot;
+  bool replaced;
+  taskENTER_CRITICAL();
+    replaced = co->dirty & slot_bit;
+    if(replaced)
+      co->coalesced++;
+    co->latest[slot] = *msg;
+    co->dirty |= slot_bit;
+  taskEXIT_CRITICAL();
+
+  return replaced ? 0 : 1;
+}
+
+
+// Returns false if the message isn't for a coalesced prop
+bool umsg_coalesce_put(UMsgCoalesce *co, UMsg *msg) {
+  return umsg_coalesce__put(co, msg) >= 0;
+}
+
+
+// Move latest message for each dirty prop into msgs. Returns number taken.
+static unsigned umsg_coalesce__take(UMsgCoalesce *co, UMsg *msgs) {
+  unsigned count = 0;
+
+  taskENTER_CRITICAL();
+    while(co->dirty) {
+      unsigned slot = __builtin_ctz(co->dirty);
+      co->dirty &= ~(1ul << slot);
+      msgs[count++] = co->latest[slot];
+    }
+  taskEXIT_CRITICAL();
+
+  return count;
+}
+
+
+// Deliver latest message for each dirty prop. Returns number delivered.
+unsigned umsg_coalesce_drain(UMsgCoalesce *co, UMsgCoalesceHandler handler) {
+  if(co->dirty == 0)
+    return 0;
+
+  unsigned count = 0;
+  while(co->dirty) {
+    UMsg msg;
+
+    taskENTER_CRITICAL();
+      unsigned slot = __builtin_ctz(co->dirty);
+      co->dirty &= ~(1ul << slot);
+      msg = co->latest[slot];
+    taskEXIT_CRITICAL();
+
+    handler(NULL, &msg);
+    count++;
+  }
+
+  return count;
+}